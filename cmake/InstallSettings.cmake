@@ -58,6 +58,8 @@ _set_fancy(XDG_DIRECTORY_INSTALL_DIR "${SHARE_INSTALL_PREFIX}/desktop-directorie
 _set_fancy(XDG_MIME_INSTALL_DIR     "${SHARE_INSTALL_PREFIX}/mime/packages"  "The install dir for the xdg mimetypes")
 
 _set_fancy(SYSCONF_INSTALL_DIR      "/etc"            "The sysconfig install dir (default /etc)")
+_set_fancy(PAM_MODULE_DIR           "${LIB_INSTALL_DIR}/security" "Where PAM looks for its modules (default ${LIB_INSTALL_DIR}/security)")
+_set_fancy(LOCALSTATE_INSTALL_DIR   "/var"            "The variable state install dir (default /var)")
 _set_fancy(MAN_INSTALL_DIR          "${SHARE_INSTALL_PREFIX}/man"            "The man install dir (default ${SHARE_INSTALL_PREFIX}/man/)")
 _set_fancy(INFO_INSTALL_DIR         "${SHARE_INSTALL_PREFIX}/info"           "The info install dir (default ${SHARE_INSTALL_PREFIX}/info)")
 _set_fancy(DBUS_INTERFACES_INSTALL_DIR      "${SHARE_INSTALL_PREFIX}/dbus-1/interfaces" "The dbus interfaces install dir (default  ${SHARE_INSTALL_PREFIX}/dbus-1/interfaces)")
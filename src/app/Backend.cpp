@@ -19,7 +19,8 @@
  */
 
 #include "Backend.h"
-#include "QAuthApp.h"
+#include "Conversation.h"
+#include "Messages.h"
 
 #include "backend/PamBackend.h"
 #include "backend/PasswdBackend.h"
@@ -29,12 +30,12 @@
 
 #include <pwd.h>
 
-Backend::Backend(QAuthApp* parent)
+Backend::Backend(Conversation *parent)
         : QObject(parent)
-        , m_app(parent) {
+        , m_conversation(parent) {
 }
 
-Backend *Backend::get(QAuthApp* parent)
+Backend *Backend::get(Conversation *parent)
 {
 #ifdef PAM_FOUND
     return new PamBackend(parent);
@@ -47,11 +48,26 @@ void Backend::setAutologin(bool on) {
     m_autologin = on;
 }
 
+void Backend::setSecret(const QByteArray &secret) {
+    wipeSecret(m_secret);
+    m_secret = ownedCopy(secret);
+}
+
+void Backend::reset() {
+    m_autologin = false;
+    wipeSecret(m_secret);
+}
+
+bool Backend::retry() {
+    wipeSecret(m_secret);
+    return true;
+}
+
 bool Backend::openSession() {
     struct passwd *pw;
-    pw = getpwnam(qPrintable(qobject_cast<QAuthApp*>(parent())->user()));
+    pw = getpwnam(qPrintable(m_conversation->user()));
     if (pw) {
-        QProcessEnvironment env = m_app->session()->processEnvironment();
+        QProcessEnvironment env = m_conversation->session()->processEnvironment();
         env.insert("HOME", pw->pw_dir);
         env.insert("PWD", pw->pw_dir);
         env.insert("SHELL", pw->pw_shell);
@@ -60,8 +76,15 @@ bool Backend::openSession() {
         // TODO if XDISPLAY?
         env.insert("XAUTHORITY", QString("%1/.Xauthority").arg(pw->pw_dir));
         // TODO: I'm fairly sure this shouldn't be done for PAM sessions, investigate!
-        m_app->session()->setProcessEnvironment(env);
+        m_conversation->session()->setProcessEnvironment(env);
+    }
+    // entries the library added after the authentication, as late as it gets
+    QProcessEnvironment late = m_conversation->environment();
+    if (!late.isEmpty()) {
+        QProcessEnvironment env = m_conversation->session()->processEnvironment();
+        env.insert(late);
+        m_conversation->session()->setProcessEnvironment(env);
     }
-    return m_app->session()->start();
+    return m_conversation->session()->start();
 }
 
@@ -21,9 +21,10 @@
 #ifndef BACKEND_H
 #define BACKEND_H
 
+#include <QtCore/QByteArray>
 #include <QtCore/QObject>
 
-class QAuthApp;
+class Conversation;
 class Backend : public QObject
 {
     Q_OBJECT
@@ -32,10 +33,29 @@ public:
      * Requests allocation of a new backend instance.
      * The method chooses the most suitable one for the current system.
      */
-    static Backend *get(QAuthApp *parent);
+    static Backend *get(Conversation *parent);
 
     void setAutologin(bool on = true);
 
+    /**
+     * The secret the library sent up front, used to answer the password
+     * prompts without asking. Wiped by \ref reset.
+     */
+    void setSecret(const QByteArray &secret);
+
+    /**
+     * Ends the current transaction and forgets everything about it,
+     * so the backend can be started again in the same process.
+     */
+    virtual void reset();
+
+    /**
+     * Prepares another attempt after a failed \ref authenticate, without
+     * starting over. The secret sent up front is forgotten, it didn't work.
+     * @return false if it can't be tried again, also when it wasn't the secret that failed
+     */
+    virtual bool retry();
+
 public slots:
     virtual bool start(const QString &user = QString()) = 0;
     virtual bool authenticate() = 0;
@@ -44,9 +64,10 @@ public slots:
     virtual QString userName() = 0;
 
 protected:
-    Backend(QAuthApp *parent);
-    QAuthApp *m_app;
+    Backend(Conversation *parent);
+    Conversation *m_conversation;
     bool m_autologin { false };
+    QByteArray m_secret { };
 
 private:
 
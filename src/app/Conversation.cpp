@@ -0,0 +1,404 @@
+/*
+ * One authentication conversation with the library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "Conversation.h"
+
+#include "Backend.h"
+#include "QAuthApp.h"
+#include "Session.h"
+#include "SafeDataStream.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QIODevice>
+
+Conversation::Conversation(QIODevice *device, QObject *parent)
+        : QObject(parent)
+        , m_backend(Backend::get(this))
+        , m_session(new Session(this))
+        , m_device(device)
+        , m_stream(new SafeDataStream(device)) {
+}
+
+Conversation::~Conversation() {
+    delete m_stream;
+}
+
+Session *Conversation::session() {
+    return m_session;
+}
+
+Backend *Conversation::backend() {
+    return m_backend;
+}
+
+const QString& Conversation::user() const {
+    return m_user;
+}
+
+void Conversation::setUser(const QString &user) {
+    m_user = user;
+}
+
+void Conversation::setDevice(QIODevice *device) {
+    m_device = device;
+    delete m_stream;
+    m_stream = new SafeDataStream(device);
+}
+
+void Conversation::setProtocol(int protocol) {
+    m_stream->setProtocol(protocol);
+}
+
+void Conversation::setBatch(bool on) {
+    m_batch = on;
+}
+
+void Conversation::setPooled(bool on) {
+    m_pooled = on;
+}
+
+void Conversation::setKeepAlive(int idleTimeout, int maxChecks) {
+    m_keepAliveTimeout = idleTimeout;
+    m_maxChecks = maxChecks;
+}
+
+void Conversation::setAttempts(int attempts) {
+    m_attempts = qMax(1, attempts);
+}
+
+void Conversation::setChannel(bool on) {
+    m_channel = on;
+}
+
+void Conversation::setCredentials(bool on) {
+    m_credentials = on;
+}
+
+int Conversation::run() {
+    // pooled helpers get the secret together with BEGIN
+    if (m_credentials && !m_pooled && !credentials()) {
+        flush();
+        return QAuthApp::OTHER_ERROR;
+    }
+
+    forever {
+        // pooled helpers get to know what to do only after they're picked up,
+        // kept alive ones wait for the next check the same way
+        if ((m_pooled || m_checks > 0) && !begin()) {
+            flush();
+            return m_checks > 0 ? QAuthApp::AUTH_SUCCESS : QAuthApp::OTHER_ERROR;
+        }
+
+        QAuthApp::RetVal result = QAuthApp::AUTH_SUCCESS;
+        if (!m_backend->start(m_user)) {
+            result = QAuthApp::AUTH_ERROR;
+        }
+        else if (!authenticate()) {
+            result = QAuthApp::AUTH_ERROR;
+        }
+        else {
+            m_user = m_backend->userName();
+            QProcessEnvironment env = authenticated(m_user);
+
+            if (!m_session->path().isEmpty()) {
+                env.insert(m_session->processEnvironment());
+                m_session->setProcessEnvironment(env);
+
+                if (!m_backend->openSession()) {
+                    sessionOpened(false);
+                    flush();
+                    return QAuthApp::SESSION_ERROR;
+                }
+
+                sessionOpened(true);
+                return -1;
+            }
+        }
+        m_checks++;
+
+        // channels always report, there's no process exiting to tell the library
+        if (!m_channel && !keepAlive()) {
+            flush();
+            return result;
+        }
+
+        compose() << Msg::FINISHED << qint32(result);
+        m_stream->send();
+        if (m_channel)
+            return result;
+        m_backend->reset();
+        m_user.clear();
+        m_environment = QProcessEnvironment();
+        m_environmentComplete = false;
+    }
+}
+
+/*
+ * Failed attempts are reported one by one, the library can show the
+ * prompts again while they're repeated over the same connection
+ */
+bool Conversation::authenticate() {
+    for (int attempt = 1; ; attempt++) {
+        if (m_backend->authenticate())
+            return true;
+        authenticated(QString(""));
+        if (attempt >= m_attempts || !m_backend->retry())
+            return false;
+        qDebug() << "Authentication failed, attempt" << attempt << "of" << m_attempts;
+    }
+}
+
+/*
+ * Only checks get to keep the helper running, sessions need a clean process
+ */
+bool Conversation::keepAlive() const {
+    if (m_keepAliveTimeout <= 0 || !m_session->path().isEmpty())
+        return false;
+    return m_maxChecks <= 0 || m_checks < m_maxChecks;
+}
+
+/*
+ * The stream ready for the next message, after any queued ones
+ */
+SafeDataStream &Conversation::compose() {
+    if (!m_queued)
+        m_stream->reset();
+    m_queued = false;
+    return *m_stream;
+}
+
+/*
+ * Sends the queued messages when there's no other message to go with them
+ */
+void Conversation::flush() {
+    if (!m_queued)
+        return;
+    m_queued = false;
+    m_stream->send();
+    m_device->waitForBytesWritten(-1);
+}
+
+bool Conversation::begin() {
+    Msg m = Msg::MSG_UNKNOWN;
+    QString sessionPath;
+    bool autologin = false;
+    SafeDataStream &str = *m_stream;
+    if (m_checks > 0 && !m_device->bytesAvailable() && !m_device->waitForReadyRead(m_keepAliveTimeout)) {
+        qDebug() << "No other check requested, quitting";
+        return false;
+    }
+    m = receive();
+    // a secret known up front comes in a frame of its own, right before BEGIN
+    if (m == CREDENTIALS) {
+        QByteArray secret = readBytes(str);
+        m_backend->setSecret(secret);
+        wipeSecret(secret);
+        m = receive();
+    }
+    // nothing of another message may end up in the fields of BEGIN
+    if (m != BEGIN) {
+        qCritical() << "Received a wrong opcode instead of BEGIN:" << m;
+        return false;
+    }
+    str >> WireString(m_user) >> WireString(sessionPath) >> autologin;
+    m_attempts = 1;
+    if (!str.atFrameEnd())
+        m_attempts = qMax<int>(1, readVarint(str));
+    // the session would outlive the thread of the channel
+    if (m_channel && !sessionPath.isEmpty()) {
+        qCritical() << "Sessions can't be started on a multiplexed connection";
+        return false;
+    }
+    m_session->setPath(sessionPath);
+    m_backend->setAutologin(autologin);
+    return true;
+}
+
+bool Conversation::credentials() {
+    SafeDataStream &str = *m_stream;
+    Msg m = receive();
+    if (m != CREDENTIALS) {
+        qCritical() << "Received a wrong opcode instead of CREDENTIALS:" << m;
+        return false;
+    }
+    QByteArray secret = readBytes(str);
+    m_backend->setSecret(secret);
+    wipeSecret(secret);
+    return true;
+}
+
+/*
+ * In the batch mode, messages not expecting any reply wait for the next one
+ * which does and go out in the same frame
+ */
+void Conversation::info(const QString& message, QAuth::Info type) {
+    SafeDataStream &str = compose();
+    str << Msg::INFO << WireString(message) << type;
+    if (m_batch) {
+        m_queued = true;
+        return;
+    }
+    str.send();
+    m_device->waitForBytesWritten(-1);
+}
+
+void Conversation::error(const QString& message, QAuth::Error type) {
+    SafeDataStream &str = compose();
+    str << Msg::ERROR << WireString(message) << type;
+    if (m_batch) {
+        m_queued = true;
+        return;
+    }
+    str.send();
+    m_device->waitForBytesWritten(-1);
+}
+
+Request Conversation::request(const Request& request) {
+    Msg m = Msg::MSG_UNKNOWN;
+    // v2 replies carry only the responses, the rest is taken from what we sent
+    Request response(request);
+    SafeDataStream &str = compose();
+    str << Msg::REQUEST << request;
+    str.send();
+    m = receive();
+    str >> Responses(response);
+    if (m != REQUEST || str.status() != QDataStream::Ok) {
+        response = Request();
+        qCritical() << "Received a wrong opcode instead of REQUEST:" << m;
+    }
+    return response;
+}
+
+/*
+ * Since v3 the environment is already here, the library isn't waited for.
+ * Only a session has to wait until the library says there's nothing more,
+ * its authentication() handlers may still be adding to it.
+ */
+QProcessEnvironment Conversation::authenticated(const QString &user) {
+    Msg m = Msg::MSG_UNKNOWN;
+    QProcessEnvironment response;
+    SafeDataStream &str = compose();
+    str << Msg::AUTHENTICATED << WireString(user);
+    str.send();
+    if (user.isEmpty())
+        return response;
+    if (str.protocol() >= PROTOCOL_V3) {
+        if (!m_session->path().isEmpty())
+            awaitEnvironment();
+        return environment();
+    }
+    m = receive();
+    str >> response;
+    if (m != AUTHENTICATED) {
+        response = QProcessEnvironment();
+        qCritical() << "Received a wrong opcode instead of AUTHENTICATED:" << m;
+    }
+    return response;
+}
+
+void Conversation::sessionOpened(bool success) {
+    Msg m = Msg::MSG_UNKNOWN;
+    SafeDataStream &str = compose();
+    str << Msg::SESSION_STATUS << success;
+    str.send();
+    if (str.protocol() >= PROTOCOL_V3) {
+        m_device->waitForBytesWritten(-1);
+        return;
+    }
+    m = receive();
+    if (m != SESSION_STATUS) {
+        qCritical() << "Received a wrong opcode instead of SESSION_STATUS:" << m;
+    }
+}
+
+QProcessEnvironment Conversation::environment() {
+    collectEnvironment();
+    QProcessEnvironment env = m_environment;
+    m_environment = QProcessEnvironment();
+    return env;
+}
+
+/*
+ * Blocks until the next message, the environment can come in between any of them
+ */
+Msg Conversation::receive() {
+    Msg m = Msg::MSG_UNKNOWN;
+    SafeDataStream &str = *m_stream;
+    forever {
+        str.receive();
+        str >> m;
+        if (m != ENVIRONMENT || str.status() != QDataStream::Ok)
+            return m;
+        readEnvironment();
+    }
+}
+
+/*
+ * An empty one is the end marker, nothing else is coming before the session starts
+ */
+void Conversation::readEnvironment() {
+    QProcessEnvironment env;
+    *m_stream >> env;
+    if (env.isEmpty())
+        m_environmentComplete = true;
+    else
+        m_environment.insert(env);
+}
+
+/*
+ * Takes whatever environment arrived in the meantime, without waiting
+ */
+void Conversation::collectEnvironment() {
+    Msg m = Msg::MSG_UNKNOWN;
+    SafeDataStream &str = *m_stream;
+    if (str.protocol() < PROTOCOL_V3)
+        return;
+    m_device->waitForReadyRead(0);
+    while (str.tryReceive()) {
+        str >> m;
+        if (m != ENVIRONMENT) {
+            qCritical() << "Received a wrong opcode instead of ENVIRONMENT:" << m;
+            continue;
+        }
+        readEnvironment();
+    }
+}
+
+/*
+ * Blocks until the end marker, the library sends it right after its
+ * authentication() handlers returned
+ */
+void Conversation::awaitEnvironment() {
+    Msg m = Msg::MSG_UNKNOWN;
+    SafeDataStream &str = *m_stream;
+    while (!m_environmentComplete) {
+        str.receive();
+        if (str.status() != QDataStream::Ok || !m_device->isOpen())
+            return;
+        str >> m;
+        if (m != ENVIRONMENT) {
+            qCritical() << "Received a wrong opcode instead of ENVIRONMENT:" << m;
+            continue;
+        }
+        readEnvironment();
+    }
+}
+
+#include "Conversation.moc"
@@ -0,0 +1,137 @@
+/*
+ * One authentication conversation with the library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef CONVERSATION_H
+#define CONVERSATION_H
+
+#include <QtCore/QObject>
+#include <QtCore/QProcessEnvironment>
+
+#include "Messages.h"
+
+class Backend;
+class Session;
+class SafeDataStream;
+class QIODevice;
+
+/**
+ * Everything the helper does for one \ref QAuth instance
+ *
+ * Talks to the library over \p device, which is either the connection of
+ * the whole helper or a channel of a multiplexed connection. The calls are
+ * blocking, in the multiplexed mode every conversation has its own thread.
+ */
+class Conversation : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Conversation(QIODevice *device, QObject *parent = 0);
+    virtual ~Conversation();
+
+    Session *session();
+    Backend *backend();
+    const QString &user() const;
+    void setUser(const QString &user);
+
+    /**
+     * Talk over \p device instead, only before \ref run
+     */
+    void setDevice(QIODevice *device);
+    void setProtocol(int protocol);
+    /**
+     * Queue INFO and ERROR messages until the next message going out
+     * or until \ref flush
+     */
+    void setBatch(bool on);
+    /**
+     * Wait for BEGIN before doing anything
+     */
+    void setPooled(bool on);
+    void setKeepAlive(int idleTimeout, int maxChecks);
+    /**
+     * How many times the user can try to authenticate, see \ref Backend::retry
+     */
+    void setAttempts(int attempts);
+    /**
+     * Serve one check on a channel of a multiplexed connection,
+     * report the result with FINISHED and stop
+     */
+    void setChannel(bool on);
+    /**
+     * Wait for the secret from the library before starting,
+     * it's never on the command line
+     */
+    void setCredentials(bool on);
+
+    /**
+     * Authenticates, and opens the session or keeps checking if told to
+     *
+     * @return the exit code of the helper or -1 when a session was started
+     */
+    int run();
+
+public slots:
+    Request request(const Request &request);
+    void info(const QString &message, QAuth::Info type);
+    void error(const QString &message, QAuth::Error type);
+    QProcessEnvironment authenticated(const QString &user);
+    void sessionOpened(bool success);
+
+    /**
+     * Environment the library sent ahead (v3), each entry is returned only once
+     */
+    QProcessEnvironment environment();
+
+    /**
+     * Sends the queued INFO and ERROR messages right away, for when the
+     * backend is going to block without having anything else to say
+     */
+    void flush();
+
+private:
+    bool begin();
+    bool authenticate();
+    bool credentials();
+    Msg receive();
+    void readEnvironment();
+    void collectEnvironment();
+    void awaitEnvironment();
+    bool keepAlive() const;
+    SafeDataStream &compose();
+
+    bool m_pooled { false };
+    bool m_channel { false };
+    bool m_batch { false };
+    bool m_credentials { false };
+    bool m_queued { false }; ///< INFO/ERROR messages waiting in \ref m_stream
+    int m_keepAliveTimeout { 0 };
+    int m_maxChecks { 0 };
+    int m_checks { 0 };
+    int m_attempts { 1 };
+    Backend *m_backend { nullptr };
+    Session *m_session { nullptr };
+    QIODevice *m_device { nullptr };
+    SafeDataStream *m_stream { nullptr }; ///< kept for the whole connection to reuse its buffer
+    QString m_user { };
+    QProcessEnvironment m_environment { }; ///< received and not taken yet
+    bool m_environmentComplete { false }; ///< the library sent the end marker
+};
+
+#endif // CONVERSATION_H
@@ -0,0 +1,325 @@
+/*
+ * Resident helper forking new helpers on request
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "ForkServer.h"
+#include "QAuthApp.h"
+
+#include "config.h"
+#include "Messages.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+
+static int childPipe[2] = { -1, -1 };
+
+static void childSignal(int) {
+    int saved = errno;
+    char c = 0;
+    if (write(childPipe[1], &c, 1) < 0) {
+        // nothing to do about it, the pipe is full and will wake us up anyway
+    }
+    errno = saved;
+}
+
+static bool readAll(int fd, char *data, qint64 length) {
+    while (length > 0) {
+        ssize_t r = read(fd, data, length);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        data += r;
+        length -= r;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const char *data, qint64 length) {
+    while (length > 0) {
+        ssize_t w = write(fd, data, length);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        data += w;
+        length -= w;
+    }
+    return true;
+}
+
+ForkServer::ForkServer(int argc, char **argv)
+        : m_program(argv[0]) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fork-server"))
+            continue;
+        else if (!strcmp(argv[i], "--socket") && i + 1 < argc)
+            m_server = argv[++i];
+        else if (!strcmp(argv[i], "--id") && i + 1 < argc)
+            m_id = QByteArray(argv[++i]).toLongLong();
+        else
+            m_args << argv[i];
+    }
+}
+
+bool ForkServer::requested(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fork-server"))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * libpam itself is linked to the helper, so only the modules need to be loaded.
+ * pam_start will find them already mapped and won't have to relocate them again.
+ */
+void ForkServer::preload() {
+#ifdef PAM_FOUND
+    for (const char *service : { "qauth-login", "qauth-check", "qauth-autologin" })
+        preloadConfig(QString("%1/%2").arg(QAUTH_PAM_CONFIG_DIR).arg(service));
+    qDebug() << " QAuth: Fork server: Preloaded" << m_modules << "PAM modules";
+#endif
+}
+
+void ForkServer::preloadConfig(const QString &path, int depth) {
+    QFile file(path);
+    // there's no sane reason for deeper includes than this, don't loop forever on broken configs
+    if (depth > 8 || !file.open(QIODevice::ReadOnly))
+        return;
+
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if (fields[0] == "@include") {
+            if (fields.length() > 1)
+                preloadConfig(QString("%1/%2").arg(QAUTH_PAM_CONFIG_DIR).arg(fields[1]), depth + 1);
+            continue;
+        }
+        if (fields.length() < 3)
+            continue;
+
+        if (fields[1] == "include" || fields[1] == "substack") {
+            preloadConfig(QString("%1/%2").arg(QAUTH_PAM_CONFIG_DIR).arg(fields[2]), depth + 1);
+            continue;
+        }
+
+        // the control field can also be a bracketed list containing spaces
+        int module = 2;
+        if (fields[1].startsWith('[')) {
+            int i = 1;
+            while (i < fields.length() && !fields[i].endsWith(']'))
+                i++;
+            module = i + 1;
+        }
+        if (module < fields.length())
+            preloadModule(fields[module]);
+    }
+}
+
+void ForkServer::preloadModule(const QString &name) {
+    QStringList candidates;
+    if (name.startsWith('/')) {
+        candidates << name;
+    }
+    else {
+        candidates << QString("%1/%2").arg(QAUTH_PAM_MODULE_DIR).arg(name);
+    }
+
+    for (const QString &path : candidates) {
+        if (!QFile::exists(path))
+            continue;
+        // never closed, the children are supposed to use it
+        if (dlopen(qPrintable(path), RTLD_NOW))
+            m_modules++;
+        else
+            qWarning() << " QAuth: Fork server: Couldn't preload" << path << dlerror();
+        return;
+    }
+}
+
+bool ForkServer::connectToLibrary() {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (m_server.isEmpty() || m_server.length() >= (int) sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, m_server.constData());
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_socket < 0)
+        return false;
+    if (::connect(m_socket, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        qCritical() << " QAuth: Fork server: Couldn't connect to" << m_server << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Same framing as SafeDataStream uses, there's no QIODevice to wrap here
+ */
+bool ForkServer::send(const QByteArray &data) {
+    qint64 length = data.length();
+    return writeAll(m_socket, (const char*) &length, sizeof(length))
+        && writeAll(m_socket, data.constData(), length);
+}
+
+bool ForkServer::receive(QByteArray &data) {
+    qint64 length = -1;
+    // the requests are a few bytes, anything big means the stream is broken
+    if (!readAll(m_socket, (char*) &length, sizeof(length)) || length < 0 || length > 4096)
+        return false;
+    data.resize(int(length));
+    return readAll(m_socket, data.data(), length);
+}
+
+void ForkServer::reap() {
+    char buffer[64];
+    while (read(childPipe[0], buffer, sizeof(buffer)) > 0) { }
+
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (!m_children.contains(pid))
+            continue;
+        QByteArray data;
+        QDataStream str(&data, QIODevice::WriteOnly);
+        str << Msg::EXITED << m_children.take(pid);
+        str << qint32(WIFEXITED(status) ? WEXITSTATUS(status) : QAuthApp::OTHER_ERROR) << bool(WIFSIGNALED(status));
+        send(data);
+    }
+}
+
+/*
+ * The arguments are never freed, they have to live as long as the QCoreApplication
+ */
+void ForkServer::becomeChild(qint64 id, int &argc, char **&argv) {
+    close(m_socket);
+    close(childPipe[0]);
+    close(childPipe[1]);
+    signal(SIGCHLD, SIG_DFL);
+
+    QList<QByteArray> args;
+    args << m_program;
+    args << "--socket" << m_server;
+    args << "--id" << QByteArray::number(id);
+    args << "--pool";
+    args << m_args;
+
+    argc = args.length();
+    argv = new char*[argc + 1];
+    for (int i = 0; i < argc; i++)
+        argv[i] = strdup(args[i].constData());
+    argv[argc] = nullptr;
+}
+
+bool ForkServer::serve(int &argc, char **&argv) {
+    preload();
+
+    if (pipe2(childPipe, O_CLOEXEC | O_NONBLOCK) != 0)
+        return false;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = childSignal;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &action, nullptr);
+
+    if (m_id <= 0 || !connectToLibrary()) {
+        qCritical() << "This application is not supposed to be executed manually";
+        return false;
+    }
+
+    QByteArray hello;
+    QDataStream helloStr(&hello, QIODevice::WriteOnly);
+    helloStr << Msg::HELLO << m_id;
+    if (!send(hello))
+        return false;
+
+    forever {
+        struct pollfd fds[2] = { { m_socket, POLLIN, 0 }, { childPipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        if (fds[1].revents & POLLIN)
+            reap();
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            QByteArray data;
+            // the library went away, the children will notice on their own
+            if (!receive(data))
+                return false;
+
+            Msg m = Msg::MSG_UNKNOWN;
+            qint64 id = 0;
+            QDataStream str(&data, QIODevice::ReadOnly);
+            str >> m >> id;
+            if (m == Msg::ABORT) {
+                // the library gave up on a child stuck in a module
+                pid_t pid = m_children.key(id, 0);
+                if (pid > 0)
+                    kill(pid, SIGTERM);
+                continue;
+            }
+            if (m != Msg::FORK || id <= 0) {
+                qWarning() << " QAuth: Fork server: Received a wrong opcode instead of FORK:" << m;
+                continue;
+            }
+
+            pid_t pid = fork();
+            if (pid == 0) {
+                becomeChild(id, argc, argv);
+                return true;
+            }
+            else if (pid < 0) {
+                qWarning() << " QAuth: Fork server: fork:" << strerror(errno);
+                QByteArray failed;
+                QDataStream failedStr(&failed, QIODevice::WriteOnly);
+                failedStr << Msg::EXITED << id << qint32(QAuthApp::OTHER_ERROR) << false;
+                send(failed);
+            }
+            else {
+                m_children[pid] = id;
+            }
+        }
+    }
+}
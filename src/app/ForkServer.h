@@ -0,0 +1,83 @@
+/*
+ * Resident helper forking new helpers on request
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+
+#include <sys/types.h>
+
+/**
+ * Fork server ("zygote") mode of the helper
+ *
+ * The process loads everything an authentication needs (Qt is linked already,
+ * the PAM modules used by our services get dlopened in advance), connects to
+ * the library and then just waits for FORK requests. Every forked child
+ * continues as a pooled helper with the same address space, so it doesn't
+ * have to go through exec, dynamic linking and loading of the modules again.
+ * Children the library gave up on are terminated on its ABORT request.
+ *
+ * No QCoreApplication is created in the server itself, the children would
+ * otherwise share its event dispatcher.
+ */
+class ForkServer {
+public:
+    ForkServer(int argc, char **argv);
+
+    /**
+     * @return true if the helper was started with --fork-server
+     */
+    static bool requested(int argc, char **argv);
+
+    /**
+     * Serves the fork requests until the library disconnects.
+     *
+     * @param argc rewritten in the forked children
+     * @param argv rewritten in the forked children
+     * @return true in a forked child which should continue as a pooled helper,
+     *         false in the server when it's time to quit
+     */
+    bool serve(int &argc, char **&argv);
+
+private:
+    void preload();
+    void preloadConfig(const QString &path, int depth = 0);
+    void preloadModule(const QString &name);
+
+    bool connectToLibrary();
+    bool send(const QByteArray &data);
+    bool receive(QByteArray &data);
+    void reap();
+    void becomeChild(qint64 id, int &argc, char **&argv);
+
+    QByteArray m_program { };
+    QByteArray m_server { };
+    qint64 m_id { -1 };
+    QList<QByteArray> m_args { }; ///< passed through to the children
+    int m_socket { -1 };
+    QMap<pid_t, qint64> m_children { };
+    int m_modules { 0 };
+};
+
+#endif // FORKSERVER_H
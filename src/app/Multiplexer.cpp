@@ -0,0 +1,140 @@
+/*
+ * Dispatcher of a multiplexed connection to the library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "Multiplexer.h"
+
+#include "ChannelDevice.h"
+#include "Conversation.h"
+#include "SafeDataStream.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QThread>
+#include <QtNetwork/QLocalSocket>
+
+class Multiplexer::Worker : public QThread {
+public:
+    Worker(ChannelDevice *device, int protocol, bool batch, QObject *parent)
+            : QThread(parent)
+            , device(device)
+            , protocol(protocol)
+            , batch(batch) { }
+
+    ChannelDevice *device { nullptr };
+    int protocol { PROTOCOL_V1 };
+    bool batch { false };
+
+protected:
+    void run() {
+        // lives in this thread together with the backend it creates
+        Conversation conversation(device);
+        conversation.setProtocol(protocol);
+        conversation.setBatch(batch);
+        conversation.setPooled(true);
+        conversation.setChannel(true);
+        // the PAM calls take turns on their own, see PamHandle
+        conversation.run();
+        device->close();
+    }
+};
+
+Multiplexer::Multiplexer(QLocalSocket *socket, int protocol, bool batch, QObject *parent)
+        : QObject(parent)
+        , m_socket(socket)
+        , m_stream(new SafeDataStream(socket))
+        , m_protocol(protocol)
+        , m_batch(batch) {
+    m_stream->setProtocol(protocol);
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(dataPending()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
+    if (m_socket->bytesAvailable() > 0)
+        dataPending();
+}
+
+Multiplexer::~Multiplexer() {
+    for (Worker *worker : m_workers) {
+        worker->device->hangUp();
+        worker->wait();
+    }
+    delete m_stream;
+}
+
+Multiplexer::Worker *Multiplexer::open(qint64 channel) {
+    ChannelDevice *device = new ChannelDevice(channel, this);
+    // the worker writes, the socket belongs to this thread
+    connect(device, SIGNAL(outgoing(qint64,QByteArray)), this, SLOT(send(qint64,QByteArray)), Qt::QueuedConnection);
+
+    Worker *worker = new Worker(device, m_protocol, m_batch, this);
+    connect(worker, SIGNAL(finished()), this, SLOT(workerFinished()));
+    m_workers[channel] = worker;
+    worker->start();
+    return worker;
+}
+
+void Multiplexer::dataPending() {
+    while (m_stream->tryReceive()) {
+        qint64 channel = 0;
+        *m_stream >> channel;
+        QByteArray chunk = readBytes(*m_stream);
+        if (m_stream->status() != QDataStream::Ok) {
+            qWarning() << " QAuth: Multiplexer: Received a broken frame";
+            continue;
+        }
+
+        Worker *worker = m_workers.value(channel, nullptr);
+        if (!worker) {
+            // closing a channel which is already gone
+            if (chunk.isEmpty())
+                continue;
+            worker = open(channel);
+        }
+        worker->device->deliver(chunk);
+    }
+}
+
+void Multiplexer::send(qint64 channel, const QByteArray &chunk) {
+    if (m_disconnected)
+        return;
+    m_stream->reset();
+    *m_stream << channel;
+    writeBytes(*m_stream, chunk);
+    m_stream->send();
+}
+
+/*
+ * The conversations in progress will fail on their own, nobody is waiting for them anymore
+ */
+void Multiplexer::disconnected() {
+    m_disconnected = true;
+    for (Worker *worker : m_workers)
+        worker->device->hangUp();
+    if (m_workers.isEmpty())
+        Q_EMIT finished();
+}
+
+void Multiplexer::workerFinished() {
+    Worker *worker = static_cast<Worker*>(sender());
+    m_workers.remove(worker->device->channel());
+    worker->device->deleteLater();
+    worker->deleteLater();
+    if (m_disconnected && m_workers.isEmpty())
+        Q_EMIT finished();
+}
+
+#include "Multiplexer.moc"
@@ -0,0 +1,76 @@
+/*
+ * Dispatcher of a multiplexed connection to the library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MULTIPLEXER_H
+#define MULTIPLEXER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+
+class SafeDataStream;
+class QLocalSocket;
+
+/**
+ * Serves many checks over a single connection
+ *
+ * Frames of the connection carry a channel ID (the ID of the \ref QAuth
+ * instance) and a chunk of that channel's stream, see \ref ChannelDevice.
+ * The first chunk of an unknown channel starts a worker thread running
+ * a \ref Conversation on it. PAM isn't thread-safe, so the calls into it
+ * take turns, but a channel waiting for the library between them doesn't
+ * hold up the others. A module waiting for the user inside a call does,
+ * the library sends the credentials up front to keep that rare. Only checks
+ * are served, sessions need their own helper.
+ *
+ * All reading and writing of the connection happens in the main thread.
+ */
+class Multiplexer : public QObject
+{
+    Q_OBJECT
+public:
+    Multiplexer(QLocalSocket *socket, int protocol, bool batch, QObject *parent = 0);
+    virtual ~Multiplexer();
+
+signals:
+    /**
+     * The library disconnected and all conversations are over
+     */
+    void finished();
+
+private slots:
+    void dataPending();
+    void send(qint64 channel, const QByteArray &chunk);
+    void disconnected();
+    void workerFinished();
+
+private:
+    class Worker;
+
+    Worker *open(qint64 channel);
+
+    QLocalSocket *m_socket { nullptr };
+    SafeDataStream *m_stream { nullptr };
+    QHash<qint64, Worker*> m_workers { };
+    int m_protocol { 0 };
+    bool m_batch { false };
+    bool m_disconnected { false };
+};
+
+#endif // MULTIPLEXER_H
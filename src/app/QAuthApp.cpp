@@ -21,8 +21,12 @@
 #include "QAuthApp.h"
 
 #include "Backend.h"
+#include "Conversation.h"
+#include "ForkServer.h"
+#include "Multiplexer.h"
 #include "Session.h"
 #include "SafeDataStream.h"
+#include "SharedRing.h"
 
 #include <QtCore/QTimer>
 #include <QtCore/QFile>
@@ -35,15 +39,18 @@
 
 QAuthApp::QAuthApp(int& argc, char** argv)
         : QCoreApplication(argc, argv)
-        , m_backend(Backend::get(this))
-        , m_session(new Session(this))
-        , m_socket(new QLocalSocket(this)) {
+        , m_socket(new QLocalSocket(this))
+        , m_conversation(new Conversation(m_socket, this)) {
     QTimer::singleShot(0, this, SLOT(setUp()));
 }
 
 void QAuthApp::setUp() {
     QStringList args = QCoreApplication::arguments();
     QString server;
+    QString ring;
+    int fd = -1;
+    int keepAliveTimeout = 0;
+    int maxChecks = 0;
     int pos;
 
     if ((pos = args.indexOf("--socket")) >= 0) {
@@ -55,6 +62,24 @@ void QAuthApp::setUp() {
         server = args[pos + 1];
     }
 
+    if ((pos = args.indexOf("--fd")) >= 0) {
+        if (pos >= args.length() - 1) {
+            qCritical() << "This application is not supposed to be executed manually";
+            exit(OTHER_ERROR);
+            return;
+        }
+        fd = QString(args[pos + 1]).toInt();
+    }
+
+    if ((pos = args.indexOf("--ring")) >= 0) {
+        if (pos >= args.length() - 1) {
+            qCritical() << "This application is not supposed to be executed manually";
+            exit(OTHER_ERROR);
+            return;
+        }
+        ring = args[pos + 1];
+    }
+
     if ((pos = args.indexOf("--id")) >= 0) {
         if (pos >= args.length() - 1) {
             qCritical() << "This application is not supposed to be executed manually";
@@ -70,7 +95,7 @@ void QAuthApp::setUp() {
             exit(OTHER_ERROR);
             return;
         }
-        m_session->setPath(args[pos + 1]);
+        m_conversation->session()->setPath(args[pos + 1]);
     }
 
     if ((pos = args.indexOf("--user")) >= 0) {
@@ -79,130 +104,133 @@ void QAuthApp::setUp() {
             exit(OTHER_ERROR);
             return;
         }
-        m_user = args[pos + 1];
+        m_conversation->setUser(args[pos + 1]);
     }
 
     if ((pos = args.indexOf("--autologin")) >= 0) {
-        m_backend->setAutologin(true);
+        m_conversation->backend()->setAutologin(true);
     }
 
-    if (server.isEmpty() || m_id <= 0) {
-        qCritical() << "This application is not supposed to be executed manually";
-        exit(OTHER_ERROR);
-        return;
+    if ((pos = args.indexOf("--pool")) >= 0) {
+        m_conversation->setPooled(true);
     }
 
-    connect(m_socket, SIGNAL(connected()), this, SLOT(doAuth()));
-    connect(m_session, SIGNAL(finished(int)), this, SLOT(sessionFinished(int)));
-    m_socket->connectToServer(server, QIODevice::ReadWrite | QIODevice::Unbuffered);
-}
+    if ((pos = args.indexOf("--batch")) >= 0) {
+        m_batch = true;
+        m_conversation->setBatch(true);
+    }
 
-void QAuthApp::doAuth() {
-    SafeDataStream str(m_socket);
-    str << Msg::HELLO << m_id;
-    str.send();
-    if (str.status() != QDataStream::Ok)
-        qCritical() << "Couldn't write initial message:" << str.status();
-
-    if (!m_backend->start(m_user)) {
-        exit(AUTH_ERROR);
-        return;
+    if ((pos = args.indexOf("--credentials")) >= 0) {
+        m_conversation->setCredentials(true);
     }
 
-    if (!m_backend->authenticate()) {
-        authenticated(QString(""));
-        exit(AUTH_ERROR);
-        return;
+    if ((pos = args.indexOf("--multiplex")) >= 0) {
+        m_multiplex = true;
     }
 
-    m_user = m_backend->userName();
-    QProcessEnvironment env = authenticated(m_user);
+    if ((pos = args.indexOf("--keep-alive")) >= 0) {
+        if (pos >= args.length() - 1) {
+            qCritical() << "This application is not supposed to be executed manually";
+            exit(OTHER_ERROR);
+            return;
+        }
+        keepAliveTimeout = QString(args[pos + 1]).toInt();
+    }
 
-    if (!m_session->path().isEmpty()) {
-        env.insert(m_session->processEnvironment());
-        m_session->setProcessEnvironment(env);
+    if ((pos = args.indexOf("--attempts")) >= 0) {
+        if (pos >= args.length() - 1) {
+            qCritical() << "This application is not supposed to be executed manually";
+            exit(OTHER_ERROR);
+            return;
+        }
+        m_conversation->setAttempts(QString(args[pos + 1]).toInt());
+    }
 
-        if (!m_backend->openSession()) {
-            sessionOpened(false);
-            exit(SESSION_ERROR);
+    if ((pos = args.indexOf("--max-checks")) >= 0) {
+        if (pos >= args.length() - 1) {
+            qCritical() << "This application is not supposed to be executed manually";
+            exit(OTHER_ERROR);
             return;
         }
+        maxChecks = QString(args[pos + 1]).toInt();
+    }
+    m_conversation->setKeepAlive(keepAliveTimeout, maxChecks);
 
-        sessionOpened(true);
+    if ((pos = args.indexOf("--protocol")) >= 0) {
+        if (pos >= args.length() - 1) {
+            qCritical() << "This application is not supposed to be executed manually";
+            exit(OTHER_ERROR);
+            return;
+        }
+        // use the newest one both sides know
+        m_protocol = qBound<int>(PROTOCOL_V1, QString(args[pos + 1]).toInt(), PROTOCOL_LATEST);
     }
-    else
-        exit(AUTH_SUCCESS);
-    return;
-}
 
-void QAuthApp::sessionFinished(int status) {
-    exit(status);
-}
+    if (fd < 0 && ring.isEmpty() && (server.isEmpty() || m_id <= 0)) {
+        qCritical() << "This application is not supposed to be executed manually";
+        exit(OTHER_ERROR);
+        return;
+    }
 
-void QAuthApp::info(const QString& message, QAuth::Info type) {
-    SafeDataStream str(m_socket);
-    str << Msg::INFO << message << type;
-    str.send();
-    m_socket->waitForBytesWritten();
-}
+    connect(m_conversation->session(), SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(sessionFinished(int)));
 
-void QAuthApp::error(const QString& message, QAuth::Error type) {
-    SafeDataStream str(m_socket);
-    str << Msg::ERROR << message << type;
-    str.send();
-    m_socket->waitForBytesWritten();
-}
+    // the library shares the memory with us, the socket isn't used at all
+    if (!ring.isEmpty()) {
+        SharedRing *device = SharedRing::attach(ring, this);
+        if (!device) {
+            exit(OTHER_ERROR);
+            return;
+        }
+        m_conversation->setDevice(device);
+        m_inherited = true;
+        doAuth();
+        return;
+    }
 
-Request QAuthApp::request(const Request& request) {
-    Msg m = Msg::MSG_UNKNOWN;
-    Request response;
-    SafeDataStream str(m_socket);
-    str << Msg::REQUEST << request;
-    str.send();
-    str.receive();
-    str >> m >> response;
-    if (m != REQUEST) {
-        response = Request();
-        qCritical() << "Received a wrong opcode instead of REQUEST:" << m;
-    }
-    return response;
-}
+    // the library gave us our end of a socketpair, there's nobody to connect to
+    if (fd >= 0) {
+        if (!m_socket->setSocketDescriptor(fd, QLocalSocket::ConnectedState, QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+            qCritical() << "Couldn't use the inherited socket:" << m_socket->errorString();
+            exit(OTHER_ERROR);
+            return;
+        }
+        m_inherited = true;
+        doAuth();
+        return;
+    }
 
-QProcessEnvironment QAuthApp::authenticated(const QString &user) {
-    Msg m = Msg::MSG_UNKNOWN;
-    QProcessEnvironment response;
-    SafeDataStream str(m_socket);
-    str << Msg::AUTHENTICATED << user;
-    str.send();
-    if (user.isEmpty())
-        return response;
-    str.receive();
-    str >> m >> response;
-    if (m != AUTHENTICATED) {
-        response = QProcessEnvironment();
-        qCritical() << "Received a wrong opcode instead of AUTHENTICATED:" << m;
-    }
-    return response;
+    connect(m_socket, SIGNAL(connected()), this, SLOT(doAuth()));
+    m_socket->connectToServer(server, QIODevice::ReadWrite | QIODevice::Unbuffered);
 }
 
-void QAuthApp::sessionOpened(bool success) {
-    Msg m = Msg::MSG_UNKNOWN;
-    SafeDataStream str(m_socket);
-    str << Msg::SESSION_STATUS << success;
-    str.send();
-    str.receive();
-    str >> m;
-    if (m != SESSION_STATUS) {
-        qCritical() << "Received a wrong opcode instead of SESSION_STATUS:" << m;
+void QAuthApp::doAuth() {
+    // only the local server needs to know who we are
+    if (!m_inherited) {
+        SafeDataStream str(m_socket);
+        str << Msg::HELLO << m_id;
+        // v1 libraries didn't offer any version and don't expect it here
+        if (m_protocol > PROTOCOL_V1)
+            str << qint32(m_protocol);
+        str.send();
+        if (str.status() != QDataStream::Ok)
+            qCritical() << "Couldn't write initial message:" << str.status();
+    }
+
+    if (m_multiplex) {
+        m_multiplexer = new Multiplexer(m_socket, m_protocol, m_batch, this);
+        connect(m_multiplexer, SIGNAL(finished()), this, SLOT(quit()));
+        return;
     }
-}
 
-Session *QAuthApp::session() {
-    return m_session;
+    m_conversation->setProtocol(m_protocol);
+    int result = m_conversation->run();
+    // a session was started, we'll quit when it ends
+    if (result >= 0)
+        exit(result);
 }
 
-const QString& QAuthApp::user() const {
-    return m_user;
+void QAuthApp::sessionFinished(int status) {
+    exit(status);
 }
 
 QAuthApp::~QAuthApp() {
@@ -210,6 +238,13 @@ QAuthApp::~QAuthApp() {
 }
 
 int main(int argc, char** argv) {
+    if (ForkServer::requested(argc, argv)) {
+        ForkServer server(argc, argv);
+        // only the forked children get past this
+        if (!server.serve(argc, argv))
+            return QAuthApp::AUTH_SUCCESS;
+    }
+
     QAuthApp app(argc, argv);
     return app.exec();
 }
@@ -26,8 +26,8 @@
 
 #include "Messages.h"
 
-class Backend;
-class Session;
+class Conversation;
+class Multiplexer;
 class QLocalSocket;
 class QAuthApp : public QCoreApplication
 {
@@ -36,9 +36,6 @@ public:
     QAuthApp(int& argc, char** argv);
     virtual ~QAuthApp();
 
-    Session *session();
-    const QString &user() const;
-
     enum RetVal {
         AUTH_SUCCESS = 0,
         AUTH_ERROR,
@@ -46,13 +43,6 @@ public:
         OTHER_ERROR
     };
 
-public slots:
-    Request request(const Request &request);
-    void info(const QString &message, QAuth::Info type);
-    void error(const QString &message, QAuth::Error type);
-    QProcessEnvironment authenticated(const QString &user);
-    void sessionOpened(bool success);
-
 private slots:
     void setUp();
     void doAuth();
@@ -61,10 +51,13 @@ private slots:
 
 private:
     qint64 m_id { -1 };
-    Backend *m_backend { nullptr };
-    Session *m_session { nullptr };
+    bool m_inherited { false };
+    bool m_multiplex { false };
+    bool m_batch { false };
+    int m_protocol { PROTOCOL_V1 };
     QLocalSocket *m_socket { nullptr };
-    QString m_user { };
+    Conversation *m_conversation { nullptr };
+    Multiplexer *m_multiplexer { nullptr };
 };
 
 #endif // QAuth_H
\ No newline at end of file
@@ -20,15 +20,15 @@
 
 #include "config.h"
 #include "Session.h"
-#include "QAuthApp.h"
+#include "Conversation.h"
 
 #include <sys/types.h>
 #include <unistd.h>
 #include <pwd.h>
 #include <grp.h>
 
-Session::Session(QAuthApp *parent)
-        : QProcess(parent) {
+Session::Session(Conversation *parent)
+        : SpawnedProcess(parent) {
     setProcessChannelMode(QProcess::ForwardedChannels);
 }
 
@@ -36,9 +36,28 @@ Session::~Session() {
 
 }
 
+/*
+ * Everything needed to drop the privileges is looked up here,
+ * the child can't do anything but plain syscalls before the exec
+ */
 bool Session::start() {
-    QProcess::start(QAUTH_XSESSION_PATH, {m_path});
-    return waitForStarted();
+    struct passwd *pw = getpwnam(qobject_cast<Conversation*>(parent())->user().toLocal8Bit());
+    if (!pw)
+        return false;
+
+    Credentials credentials;
+    credentials.uid = pw->pw_uid;
+    credentials.gid = pw->pw_gid;
+    credentials.home = pw->pw_dir;
+
+    int count = 16;
+    credentials.groups.resize(count);
+    while (getgrouplist(pw->pw_name, pw->pw_gid, credentials.groups.data(), &count) < 0)
+        credentials.groups.resize(count);
+    credentials.groups.resize(count);
+
+    setCredentials(credentials);
+    return SpawnedProcess::start(QAUTH_XSESSION_PATH, {m_path});
 }
 
 void Session::setPath(const QString& path) {
@@ -49,20 +68,4 @@ QString Session::path() const {
     return m_path;
 }
 
-void Session::bail(int status) {
-    emit finished(status, QProcess::NormalExit);
-    exit(status);
-}
-
-void Session::setupChildProcess() {
-    struct passwd *pw = getpwnam(qobject_cast<QAuthApp*>(parent())->user().toLocal8Bit());
-    if (setgid(pw->pw_gid) != 0)
-        bail(2);
-    if (initgroups(pw->pw_name, pw->pw_gid) != 0)
-        bail(2);
-    if (setuid(pw->pw_uid) != 0)
-        bail(2);
-    chdir(pw->pw_dir);
-}
-
 #include "Session.moc"
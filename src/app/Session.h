@@ -23,14 +23,15 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
-#include <QtCore/QProcess>
 
-class QAuthApp;
-class Session : public QProcess
+#include "SpawnedProcess.h"
+
+class Conversation;
+class Session : public SpawnedProcess
 {
     Q_OBJECT
 public:
-    explicit Session(QAuthApp *parent);
+    explicit Session(Conversation *parent);
     virtual ~Session();
 
     bool start();
@@ -38,10 +39,6 @@ public:
     void setPath(const QString &path);
     QString path() const;
 
-protected:
-    void bail(int status);
-    void setupChildProcess();
-
 private:
     QString m_path { };
 };
@@ -19,7 +19,9 @@
  */
 #include "PamBackend.h"
 #include "PamHandle.h"
-#include "app/QAuthApp.h"
+#include "PromptClassifier.h"
+#include "PromptHistory.h"
+#include "app/Conversation.h"
 #include "app/Session.h"
 
 #include "lib/qauth.h"
@@ -54,29 +56,41 @@ static Prompt invalidPrompt {};
 
 PamData::PamData() { }
 
-QAuthPrompt::Type PamData::detectPrompt(const struct pam_message* msg) const {
-    if (msg->msg_style == PAM_PROMPT_ECHO_OFF) {
-        QString message(msg->msg);
-        if (message.indexOf(QRegExp("\\bpassword\\b", Qt::CaseInsensitive)) >= 0) {
-            if (message.indexOf(QRegExp("\\b(re-?(enter|type)|again|confirm|repeat)\\b", Qt::CaseInsensitive)) >= 0) {
-                return QAuthPrompt::CHANGE_REPEAT;
-            }
-            else if (message.indexOf(QRegExp("\\bnew\\b", Qt::CaseInsensitive)) >= 0) {
-                return QAuthPrompt::CHANGE_NEW;
-            }
-            else if (message.indexOf(QRegExp("\\b(old|current)\\b", Qt::CaseInsensitive)) >= 0) {
-                return QAuthPrompt::CHANGE_CURRENT;
-            }
-            else {
-                return QAuthPrompt::LOGIN_PASSWORD;
-            }
-        }
-    }
-    else {
-        return QAuthPrompt::LOGIN_USER;
-    }
+PamData::~PamData() {
+    delete m_history;
+}
+
+/*
+ * Loaded again for every transaction, the configuration might have changed since
+ */
+void PamData::setService(const QString &service, const QString &user) {
+    m_service = service;
+    delete m_history;
+    m_history = nullptr;
+    setUser(user);
+}
 
-    return QAuthPrompt::UNKNOWN;
+/*
+ * Nothing is predicted until it's known who's authenticating
+ */
+void PamData::setUser(const QString &user) {
+    if (m_history && m_history->user() == user)
+        return;
+    delete m_history;
+    m_history = nullptr;
+    if (!m_service.isEmpty() && !user.isEmpty())
+        m_history = new PromptHistory(m_service, user);
+}
+
+void PamData::learn(const QString &user) {
+    // the user might have been asked for only during the authentication
+    setUser(user);
+    if (m_history)
+        m_history->learn(m_observed, m_predicted);
+}
+
+QAuthPrompt::Type PamData::detectPrompt(const struct pam_message* msg) const {
+    return PromptClassifier::instance()->prompt(msg->msg, msg->msg_style != PAM_PROMPT_ECHO_OFF);
 }
 
 const Prompt& PamData::findPrompt(const struct pam_message* msg) const {
@@ -107,6 +121,8 @@ Prompt& PamData::findPrompt(const struct pam_message* msg) {
  * Expects an empty prompt list if the previous request has been processed
  */
 bool PamData::insertPrompt(const struct pam_message* msg, bool predict) {
+    m_observed.prompts.append(Prompt(detectPrompt(msg), msg->msg, msg->msg_style == PAM_PROMPT_ECHO_OFF));
+
     Prompt &p = findPrompt(msg);
 
     // first, check if we already have stored this propmpt
@@ -129,6 +145,16 @@ bool PamData::insertPrompt(const struct pam_message* msg, bool predict) {
 
     // we'll predict what will come next
     if (predict) {
+        // what the service asked for the last time beats the templates
+        if (m_history && m_observed.prompts.length() == 1) {
+            const Request &learned = m_history->predict(m_observed.prompts.first());
+            if (learned.valid()) {
+                m_currentRequest = Request(learned);
+                m_predicted = true;
+                return true;
+            }
+        }
+
         QAuthPrompt::Type type = detectPrompt(msg);
         switch (type) {
             case QAuthPrompt::LOGIN_USER:
@@ -152,12 +178,10 @@ bool PamData::insertPrompt(const struct pam_message* msg, bool predict) {
 }
 
 QAuth::Info PamData::handleInfo(const struct pam_message* msg, bool predict) {
-    if (QString(msg->msg).indexOf(QRegExp("^Changing password for [^ ]+$"))) {
-        if (predict)
-            m_currentRequest = Request(changePassRequest);
-        return QAuth::INFO_PASS_CHANGE_REQUIRED;
-    }
-    return QAuth::INFO_UNKNOWN;
+    QAuth::Info type = PromptClassifier::instance()->info(msg->msg);
+    if (type == QAuth::INFO_PASS_CHANGE_REQUIRED && predict)
+        m_currentRequest = Request(changePassRequest);
+    return type;
 }
 
 /*
@@ -171,6 +195,13 @@ QByteArray PamData::getResponse(const struct pam_message* msg) {
     return response;
 }
 
+void PamData::clear() {
+    m_currentRequest.clear();
+    m_sent = false;
+    m_observed.clear();
+    m_predicted = false;
+}
+
 const Request& PamData::getRequest() const {
     if (!m_sent)
         return m_currentRequest;
@@ -197,10 +228,41 @@ void PamData::completeRequest(const Request& request) {
     m_sent = true;
 }
 
+/*
+ * Fills the login prompts with what we know up front. Before the request is
+ * sent it's all or nothing, the library gets either the whole request or none
+ * of it. After it's been answered, only the responses left empty are filled.
+ * @return true if the request doesn't have to be sent
+ */
+bool PamData::answer(const QByteArray &user, const QByteArray &secret) {
+    if (!m_sent) {
+        for (const Prompt &p : m_currentRequest.prompts) {
+            if (!p.response.isEmpty())
+                continue;
+            if (p.type == QAuthPrompt::LOGIN_USER && !user.isEmpty())
+                continue;
+            if (p.type == QAuthPrompt::LOGIN_PASSWORD && !secret.isEmpty())
+                continue;
+            return false;
+        }
+    }
+
+    for (Prompt &p : m_currentRequest.prompts) {
+        if (!p.response.isEmpty())
+            continue;
+        if (p.type == QAuthPrompt::LOGIN_USER)
+            p.response = user;
+        else if (p.type == QAuthPrompt::LOGIN_PASSWORD)
+            p.response = secret;
+    }
+    m_sent = true;
+    return true;
+}
+
 
 
 
-PamBackend::PamBackend(QAuthApp *parent)
+PamBackend::PamBackend(Conversation *parent)
         : Backend(parent)
         , m_data(new PamData())
         , m_pam(new PamHandle(this)) {
@@ -211,29 +273,65 @@ PamBackend::~PamBackend() {
     delete m_pam;
 }
 
+void PamBackend::reset() {
+    m_pam->end();
+    m_data->clear();
+    m_rejected = false;
+    Backend::reset();
+}
+
+/*
+ * A new transaction for every attempt. The old one still holds the rejected
+ * password, modules with try_first_pass or use_first_pass would take it again
+ * without asking, and applications aren't allowed to clear PAM_AUTHTOK and
+ * PAM_OLDAUTHTOK themselves. The user is forgotten the same way if it was
+ * asked for, whoever tries next might be someone else.
+ *
+ * Only a secret the modules turned down is worth another attempt. An expired
+ * or locked account stays that way, and a stack that gave up on its own
+ * (PAM_MAXTRIES, PAM_ABORT) would only count it against the user.
+ */
+bool PamBackend::retry() {
+    if (!m_rejected)
+        return false;
+    m_rejected = false;
+    m_pam->end();
+    m_data->clear();
+    if (!Backend::retry())
+        return false;
+    return start(m_conversation->user());
+}
+
 bool PamBackend::start(const QString &user) {
-    bool result;
+    QString service;
 
-    if (m_app->session()->path().isEmpty())
-        result = m_pam->start("qauth-check", user);
+    if (m_conversation->session()->path().isEmpty())
+        service = "qauth-check";
     else if (m_autologin)
-        result = m_pam->start("qauth-autologin", user);
+        service = "qauth-autologin";
     else
-        result = m_pam->start("qauth-login", user);
+        service = "qauth-login";
+
+    m_data->setService(service, user);
+    bool result = m_pam->start(service, user);
 
     if (!result)
-        m_app->error(m_pam->errorString(), QAuth::ERROR_INTERNAL);
+        m_conversation->error(m_pam->errorString(), QAuth::ERROR_INTERNAL);
 
     return result;
 }
 
 bool PamBackend::authenticate() {
+    m_rejected = false;
     if (!m_pam->authenticate()) {
-        m_app->error(m_pam->errorString(), QAuth::ERROR_AUTHENTICATION);
+        m_rejected = m_pam->result() == PAM_AUTH_ERR;
+        m_conversation->error(m_pam->errorString(), QAuth::ERROR_AUTHENTICATION);
         return false;
     }
+    // before an expired password adds its own prompts
+    m_data->learn(userName());
     if (!m_pam->acctMgmt()) {
-        m_app->error(m_pam->errorString(), QAuth::ERROR_AUTHENTICATION);
+        m_conversation->error(m_pam->errorString(), QAuth::ERROR_AUTHENTICATION);
         return false;
     }
     return true;
@@ -241,21 +339,21 @@ bool PamBackend::authenticate() {
 
 bool PamBackend::openSession() {
     if (!m_pam->setCred(PAM_ESTABLISH_CRED)) {
-        m_app->error(m_pam->errorString(), QAuth::ERROR_AUTHENTICATION);
+        m_conversation->error(m_pam->errorString(), QAuth::ERROR_AUTHENTICATION);
         return false;
     }
-    QString display = m_app->session()->processEnvironment().value("DISPLAY");
+    QString display = m_conversation->session()->processEnvironment().value("DISPLAY");
     if (!display.isEmpty()) {
         m_pam->setItem(PAM_XDISPLAY, qPrintable(display));
         m_pam->setItem(PAM_TTY, qPrintable(display));
     }
     if (!m_pam->openSession()) {
-        m_app->error(m_pam->errorString(), QAuth::ERROR_INTERNAL);
+        m_conversation->error(m_pam->errorString(), QAuth::ERROR_INTERNAL);
         return false;
     }
     QProcessEnvironment env = m_pam->getEnv();
-    env.insert(m_app->session()->processEnvironment());
-    m_app->session()->setProcessEnvironment(env);
+    env.insert(m_conversation->session()->processEnvironment());
+    m_conversation->session()->setProcessEnvironment(env);
     return Backend::openSession();
 }
 
@@ -278,11 +376,11 @@ int PamBackend::converse(int n, const struct pam_message **msg, struct pam_respo
                 newRequest = m_data->insertPrompt(msg[i], n == 1);
                 break;
             case PAM_ERROR_MSG:
-                m_app->error(msg[i]->msg, QAuth::ERROR_AUTHENTICATION);
+                m_conversation->error(msg[i]->msg, QAuth::ERROR_AUTHENTICATION);
                 break;
             case PAM_TEXT_INFO:
                 // if there's only the info message, let's predict the prompts too
-                m_app->info(msg[i]->msg, m_data->handleInfo(msg[i], n == 1));
+                m_conversation->info(msg[i]->msg, m_data->handleInfo(msg[i], n == 1));
                 break;
             default:
                 break;
@@ -290,19 +388,26 @@ int PamBackend::converse(int n, const struct pam_message **msg, struct pam_respo
     }
 
     if (newRequest) {
+        QByteArray user = m_conversation->user().toUtf8();
         Request sent = m_data->getRequest();
         Request received;
 
-        if (sent.valid()) {
-            received = m_app->request(sent);
+        // the round trip is needed only for what wasn't known up front
+        if (sent.valid() && !m_data->answer(user, m_secret)) {
+            received = m_conversation->request(sent);
 
             if (!received.valid())
                 return PAM_CONV_ERR;
 
             m_data->completeRequest(received);
+            m_data->answer(user, m_secret);
         }
     }
 
+    // the module may block as soon as we return, like waiting for a finger
+    // on the reader, so whatever it wanted to tell the user can't wait
+    m_conversation->flush();
+
     *resp = (struct pam_response *) calloc(n, sizeof(struct pam_response));
     if (!*resp) {
         return PAM_BUF_ERR;
@@ -30,19 +30,37 @@
 
 class PamHandle;
 class PamBackend;
+class PromptHistory;
 
 class PamData {
 public:
     PamData();
+    ~PamData();
+
+    /**
+     * Predict the prompts from the history of \p service, see \ref PromptHistory
+     */
+    void setService(const QString &service, const QString &user);
+    /**
+     * Switch to the history of \p user, an empty one predicts nothing
+     */
+    void setUser(const QString &user);
+    /**
+     * The authentication of \p user succeeded, remember what was asked
+     */
+    void learn(const QString &user);
 
     bool insertPrompt(const struct pam_message *msg, bool predict = true);
     QAuth::Info handleInfo(const struct pam_message *msg, bool predict);
 
     const Request& getRequest() const;
     void completeRequest(const Request& request);
+    bool answer(const QByteArray &user, const QByteArray &secret);
 
     QByteArray getResponse(const struct pam_message *msg);
 
+    void clear();
+
 private:
     QAuthPrompt::Type detectPrompt(const struct pam_message *msg) const;
 
@@ -51,16 +69,23 @@ private:
 
     bool m_sent { false };
     Request m_currentRequest { };
+    QString m_service { };
+    PromptHistory *m_history { nullptr };
+    Request m_observed { }; ///< every prompt PAM asked for since \ref clear
+    bool m_predicted { false }; ///< the history predicted the prompts
 };
 
 class PamBackend : public Backend
 {
     Q_OBJECT
 public:
-    explicit PamBackend(QAuthApp *parent);
+    explicit PamBackend(Conversation *parent);
     virtual ~PamBackend();
     int converse(int n, const struct pam_message **msg, struct pam_response **resp);
 
+    virtual void reset();
+    virtual bool retry();
+
 public slots:
     virtual bool start(const QString &user = QString());
     virtual bool authenticate();
@@ -71,6 +96,7 @@ public slots:
 private:
     PamData *m_data { nullptr };
     PamHandle *m_pam { nullptr };
+    bool m_rejected { false }; ///< pam_authenticate itself turned the secret down
 };
 
 #endif // PAMBACKEND_H
@@ -21,6 +21,15 @@
 #include "PamBackend.h"
 
 #include <QtCore/QDebug>
+#include <QtCore/QMutex>
+
+/*
+ * Neither libpam nor its modules promise to be thread-safe and the multiplexed
+ * helper runs a conversation in each of its threads, so the calls running
+ * modules take turns. Only the calls themselves, a conversation waiting for
+ * the library between them doesn't hold up the others.
+ */
+static QMutex pamMutex;
 
 bool PamHandle::putEnv(const QProcessEnvironment& env) {
     foreach (const QString& s, env.toStringList()) {
@@ -60,6 +69,7 @@ QProcessEnvironment PamHandle::getEnv() {
 }
 
 bool PamHandle::chAuthTok(int flags) {
+    QMutexLocker locker(&pamMutex);
     m_result = pam_chauthtok(m_handle, flags | m_silent);
     if (m_result != PAM_SUCCESS) {
         qWarning() << " AUTH: PAM: chAuthTok:" << pam_strerror(m_handle, m_result);
@@ -68,7 +78,10 @@ bool PamHandle::chAuthTok(int flags) {
 }
 
 bool PamHandle::acctMgmt(int flags) {
-    m_result = pam_acct_mgmt(m_handle, flags | m_silent);
+    {
+        QMutexLocker locker(&pamMutex);
+        m_result = pam_acct_mgmt(m_handle, flags | m_silent);
+    }
     if (m_result == PAM_NEW_AUTHTOK_REQD) {
         // TODO see if this should really return the value or just true regardless of the outcome
         return chAuthTok(PAM_CHANGE_EXPIRED_AUTHTOK);
@@ -82,7 +95,10 @@ bool PamHandle::acctMgmt(int flags) {
 
 bool PamHandle::authenticate(int flags) {
     qDebug() << " AUTH: PAM: Authenticating...";
-    m_result = pam_authenticate(m_handle, flags | m_silent);
+    {
+        QMutexLocker locker(&pamMutex);
+        m_result = pam_authenticate(m_handle, flags | m_silent);
+    }
     if (m_result != PAM_SUCCESS) {
         qWarning() << " AUTH: PAM: authenticate:" << pam_strerror(m_handle, m_result);
     }
@@ -91,6 +107,7 @@ bool PamHandle::authenticate(int flags) {
 }
 
 bool PamHandle::setCred(int flags) {
+    QMutexLocker locker(&pamMutex);
     m_result = pam_setcred(m_handle, flags | m_silent);
     if (m_result != PAM_SUCCESS) {
         qWarning() << " AUTH: PAM: setCred:" << pam_strerror(m_handle, m_result);
@@ -99,6 +116,7 @@ bool PamHandle::setCred(int flags) {
 }
 
 bool PamHandle::openSession() {
+    QMutexLocker locker(&pamMutex);
     m_result = pam_open_session(m_handle, m_silent);
     if (m_result != PAM_SUCCESS) {
         qWarning() << " AUTH: PAM: openSession:" << pam_strerror(m_handle, m_result);
@@ -107,6 +125,7 @@ bool PamHandle::openSession() {
 }
 
 bool PamHandle::closeSession() {
+    QMutexLocker locker(&pamMutex);
     m_result = pam_close_session(m_handle, m_silent);
     if (m_result != PAM_SUCCESS) {
         qWarning() << " AUTH: PAM: closeSession:" << pam_strerror(m_handle, m_result);
@@ -138,6 +157,7 @@ int PamHandle::converse(int n, const struct pam_message **msg, struct pam_respon
 }
 
 bool PamHandle::start(const QString &service, const QString &user) {
+    QMutexLocker locker(&pamMutex);
     if (user.isEmpty())
         m_result = pam_start(qPrintable(service), NULL, &m_conv, &m_handle);
     else
@@ -155,6 +175,7 @@ bool PamHandle::start(const QString &service, const QString &user) {
 bool PamHandle::end(int flags) {
     if (!m_handle)
         return false;
+    QMutexLocker locker(&pamMutex);
     m_result = pam_end(m_handle, m_result | flags);
     if (m_result != PAM_SUCCESS) {
         qWarning() << " AUTH: PAM: end:" << pam_strerror(m_handle, m_result);
@@ -171,6 +192,10 @@ QString PamHandle::errorString() {
     return pam_strerror(m_handle, m_result);
 }
 
+int PamHandle::result() const {
+    return m_result;
+}
+
 PamHandle::PamHandle(PamBackend *parent) {
     // create context
     m_conv = { &PamHandle::converse, parent };
@@ -172,6 +172,11 @@ public:
      */
     QString errorString();
 
+    /**
+     * \return the result of the last call
+     */
+    int result() const;
+
 private:
     /**
      * Conversation function for the pam_conv structure
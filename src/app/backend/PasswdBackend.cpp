@@ -21,16 +21,28 @@
 #include "PasswdBackend.h"
 
 #include "Messages.h"
-#include "../QAuthApp.h"
+#include "../Conversation.h"
 
 #include <QtCore/QDebug>
+#include <QtCore/QScopedPointer>
 
 #include <sys/types.h>
 #include <pwd.h>
 #include <shadow.h>
 #include <crypt.h>
+#include <string.h>
+#include <unistd.h>
 
-PasswdBackend::PasswdBackend(QAuthApp* parent)
+/*
+ * Multiplexed checks run in threads, so only the reentrant variants
+ * of the lookups can be used, the others share their static buffers
+ */
+static QByteArray lookupBuffer() {
+    long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    return QByteArray(size > 0 ? int(size) : 16384, 0);
+}
+
+PasswdBackend::PasswdBackend(Conversation *parent)
         : Backend(parent) { }
 
 bool PasswdBackend::authenticate() {
@@ -38,50 +50,82 @@ bool PasswdBackend::authenticate() {
         return true;
 
     Request r;
-    QString password;
-
-    if (m_user.isEmpty())
-        r.prompts << Prompt(QAuthPrompt::LOGIN_USER, "Login", false);
-    r.prompts << Prompt(QAuthPrompt::LOGIN_PASSWORD, "Password", true);
-
-    Request response = m_app->request(r);
-    Q_FOREACH(const Prompt &p, response.prompts) {
-        switch (p.type) {
-            case QAuthPrompt::LOGIN_USER:
-                m_user = p.response;
-                break;
-            case QAuthPrompt::LOGIN_PASSWORD:
-                password = p.response;
-                break;
-            default:
-                break;
+    // ours to wipe, it never goes through a QString
+    QByteArray password = ownedCopy(m_secret);
+
+    // nothing to ask when everything came up front
+    if (m_user.isEmpty() || password.isEmpty()) {
+        if (m_user.isEmpty())
+            r.prompts << Prompt(QAuthPrompt::LOGIN_USER, "Login", false);
+        r.prompts << Prompt(QAuthPrompt::LOGIN_PASSWORD, "Password", true);
+
+        Request response = m_conversation->request(r);
+        for (Prompt &p : response.prompts) {
+            switch (p.type) {
+                case QAuthPrompt::LOGIN_USER:
+                    m_user = p.response;
+                    break;
+                case QAuthPrompt::LOGIN_PASSWORD:
+                    if (!p.response.isEmpty()) {
+                        wipeSecret(password);
+                        password = ownedCopy(p.response);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            wipeSecret(p.response);
         }
     }
 
-    struct passwd *pw = getpwnam(qPrintable(m_user));
-    if (!pw) {
-        m_app->error(QString("Wrong user/password combination"), QAuth::ERROR_AUTHENTICATION);
+    struct passwd pwEntry, *pw = nullptr;
+    QByteArray pwBuffer = lookupBuffer();
+    if (getpwnam_r(qPrintable(m_user), &pwEntry, pwBuffer.data(), pwBuffer.size(), &pw) != 0 || !pw) {
+        wipeSecret(password);
+        m_conversation->error(QString("Wrong user/password combination"), QAuth::ERROR_AUTHENTICATION);
         return false;
     }
 
-    struct spwd *spw = getspnam(pw->pw_name);
-    if (!spw) {
+    struct spwd spEntry, *spw = nullptr;
+    QByteArray spBuffer = lookupBuffer();
+    if (getspnam_r(pw->pw_name, &spEntry, spBuffer.data(), spBuffer.size(), &spw) != 0 || !spw) {
         qWarning() << " QAuth: Shadow: Could get passwd but not shadow";
+        wipeSecret(password);
         return false;
     }
 
-    if(!spw->sp_pwdp || !spw->sp_pwdp[0])
+    if(!spw->sp_pwdp || !spw->sp_pwdp[0]) {
+        wipeSecret(password);
         return true;
+    }
 
-    char *crypted = crypt(qPrintable(password), spw->sp_pwdp);
-    if (0 == strcmp(crypted, spw->sp_pwdp)) {
+    // too big for the stack of a worker thread
+    QScopedPointer<struct crypt_data> data(new struct crypt_data);
+    memset(data.data(), 0, sizeof(struct crypt_data));
+    char *crypted = crypt_r(password.constData(), spw->sp_pwdp, data.data());
+    bool matches = crypted && 0 == strcmp(crypted, spw->sp_pwdp);
+    wipeSecret(password);
+    memset(data.data(), 0, sizeof(struct crypt_data));
+    memset(spBuffer.data(), 0, spBuffer.size());
+    if (matches) {
         return true;
     }
 
-    m_app->error(QString("Wrong user/password combination"), QAuth::ERROR_AUTHENTICATION);
+    m_conversation->error(QString("Wrong user/password combination"), QAuth::ERROR_AUTHENTICATION);
     return false;
 }
 
+void PasswdBackend::reset() {
+    m_user.clear();
+    Backend::reset();
+}
+
+bool PasswdBackend::retry() {
+    // ask for the user again if it wasn't given
+    m_user = m_conversation->user();
+    return Backend::retry();
+}
+
 bool PasswdBackend::start(const QString& user) {
     m_user = user;
     return true;
@@ -26,7 +26,10 @@
 class PasswdBackend : public Backend {
     Q_OBJECT
 public:
-    PasswdBackend(QAuthApp *parent);
+    PasswdBackend(Conversation *parent);
+
+    virtual void reset();
+    virtual bool retry();
 
 public slots:
     virtual bool start(const QString &user = QString());
@@ -0,0 +1,173 @@
+/*
+ * Classification of the messages coming from PAM
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "PromptClassifier.h"
+#include "config.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include <stdlib.h>
+
+// messages carrying user names would otherwise grow the caches forever
+#define CLASSIFIER_CACHE_SIZE 256
+
+PromptClassifier *PromptClassifier::instance() {
+    // compiled by whichever thread needs it first
+    static PromptClassifier self;
+    return &self;
+}
+
+PromptClassifier::PromptClassifier()
+        : m_password(compile("\\bpassword\\b"))
+        , m_repeat(compile("\\b(re-?(enter|type)|again|confirm|repeat)\\b"))
+        , m_new(compile("\\bnew\\b"))
+        , m_current(compile("\\b(old|current)\\b"))
+        , m_passChange(compile("^Changing password for [^ ]+$", true)) {
+    QString locale = qgetenv("LC_ALL");
+    if (locale.isEmpty())
+        locale = qgetenv("LC_MESSAGES");
+    if (locale.isEmpty())
+        locale = qgetenv("LANG");
+    // de_AT.UTF-8@euro -> de_AT, de
+    locale = locale.section('.', 0, 0).section('@', 0, 0);
+    if (locale.isEmpty() || locale == "C" || locale == "POSIX")
+        return;
+
+    QStringList candidates;
+    candidates << locale;
+    if (locale.contains('_'))
+        candidates << locale.section('_', 0, 0);
+    for (const QString &candidate : candidates) {
+        if (load(QString("%1/%2.rules").arg(QAUTH_PROMPT_RULES_DIR).arg(candidate))) {
+            m_locale = candidate;
+            return;
+        }
+    }
+}
+
+bool PromptClassifier::load(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    QHash<QString, QStringList> rules;
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        int pos = line.indexOf('=');
+        if (pos <= 0) {
+            qWarning() << " AUTH: Classifier: Ignoring a malformed line in" << path << ":" << line;
+            continue;
+        }
+        rules[line.left(pos).trimmed()] << line.mid(pos + 1).trimmed();
+    }
+
+    struct {
+        const char *key;
+        Pattern *pattern;
+        bool caseSensitive;
+    } keys[] = {
+        { "password", &m_password, false },
+        { "repeat", &m_repeat, false },
+        { "new", &m_new, false },
+        { "current", &m_current, false },
+        { "password-change", &m_passChange, true },
+    };
+    for (auto &key : keys) {
+        if (!rules.contains(key.key))
+            continue;
+        Pattern pattern = compile(rules.value(key.key).join("|"), key.caseSensitive);
+        if (!pattern.isValid()) {
+            qWarning() << " AUTH: Classifier: Invalid rule" << key.key << "in" << path;
+            continue;
+        }
+        *key.pattern = pattern;
+    }
+    return true;
+}
+
+PromptClassifier::Pattern PromptClassifier::compile(const QString &pattern, bool caseSensitive) {
+#if QT_VERSION >= 0x050000
+    return Pattern(pattern, caseSensitive ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
+#else
+    return Pattern(pattern, caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive, QRegExp::RegExp2);
+#endif
+}
+
+bool PromptClassifier::matches(const Pattern &pattern, const QString &text) {
+#if QT_VERSION >= 0x050000
+    return pattern.match(text).hasMatch();
+#else
+    // QRegExp keeps the state of the last match, so every match gets its own
+    // copy, the compiled engine itself is cached by Qt
+    return Pattern(pattern).indexIn(text) >= 0;
+#endif
+}
+
+QAuthPrompt::Type PromptClassifier::prompt(const QString &message, bool echo) {
+    if (echo)
+        return QAuthPrompt::LOGIN_USER;
+
+    QMutexLocker locker(&m_lock);
+    auto it = m_prompts.constFind(message);
+    if (it != m_prompts.constEnd())
+        return *it;
+
+    QAuthPrompt::Type type = QAuthPrompt::UNKNOWN;
+    if (matches(m_password, message)) {
+        if (matches(m_repeat, message))
+            type = QAuthPrompt::CHANGE_REPEAT;
+        else if (matches(m_new, message))
+            type = QAuthPrompt::CHANGE_NEW;
+        else if (matches(m_current, message))
+            type = QAuthPrompt::CHANGE_CURRENT;
+        else
+            type = QAuthPrompt::LOGIN_PASSWORD;
+    }
+
+    if (m_prompts.size() >= CLASSIFIER_CACHE_SIZE)
+        m_prompts.clear();
+    m_prompts.insert(message, type);
+    return type;
+}
+
+QAuth::Info PromptClassifier::info(const QString &message) {
+    QMutexLocker locker(&m_lock);
+    auto it = m_infos.constFind(message);
+    if (it != m_infos.constEnd())
+        return *it;
+
+    QAuth::Info type = matches(m_passChange, message) ? QAuth::INFO_PASS_CHANGE_REQUIRED : QAuth::INFO_UNKNOWN;
+
+    if (m_infos.size() >= CLASSIFIER_CACHE_SIZE)
+        m_infos.clear();
+    m_infos.insert(message, type);
+    return type;
+}
+
+QString PromptClassifier::locale() const {
+    return m_locale;
+}
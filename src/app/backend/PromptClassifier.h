@@ -0,0 +1,98 @@
+/*
+ * Classification of the messages coming from PAM
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef PROMPTCLASSIFIER_H
+#define PROMPTCLASSIFIER_H
+
+#include "lib/qauth.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+#if QT_VERSION >= 0x050000
+# include <QtCore/QRegularExpression>
+#else
+# include <QtCore/QRegExp>
+#endif
+
+/**
+ * Tells what PAM asks for from the text of its messages
+ *
+ * The rules are compiled once per process and every message is classified
+ * only once, the results are cached by the text of the message. It's shared
+ * by all conversations, multiplexed ones running in their own threads too.
+ *
+ * The built-in rules cover the English messages of Linux-PAM. Others can be
+ * loaded for the locale of the helper's messages (LC_ALL, LC_MESSAGES or
+ * LANG) from QAUTH_PROMPT_RULES_DIR, trying "de_AT.rules" before "de.rules".
+ * Each line of a rule file is a key and a case-insensitive regular expression:
+ *
+ *     password = \bpasswor(t|d)\b
+ *     new = \bneue[sn]?\b
+ *
+ * The keys are "password", "repeat", "new" and "current" for the prompts and
+ * "password-change" for the info message announcing a password change
+ * (case-sensitive). Repeated keys are alternatives, missing ones keep the
+ * built-in rule. Lines starting with # are comments.
+ *
+ * The library starts its helpers with LANG=C, so unless that's changed only
+ * the built-in rules are used.
+ */
+class PromptClassifier {
+public:
+    static PromptClassifier *instance();
+
+    /**
+     * @param echo true if the response is to be shown while typing
+     */
+    QAuthPrompt::Type prompt(const QString &message, bool echo);
+    QAuth::Info info(const QString &message);
+
+    /**
+     * @return the locale of the loaded rules, "C" for the built-in ones
+     */
+    QString locale() const;
+
+private:
+#if QT_VERSION >= 0x050000
+    typedef QRegularExpression Pattern;
+#else
+    typedef QRegExp Pattern;
+#endif
+
+    PromptClassifier();
+    bool load(const QString &path);
+    static Pattern compile(const QString &pattern, bool caseSensitive = false);
+    static bool matches(const Pattern &pattern, const QString &text);
+
+    Pattern m_password { };
+    Pattern m_repeat { };
+    Pattern m_new { };
+    Pattern m_current { };
+    Pattern m_passChange { };
+    QString m_locale { "C" };
+
+    QMutex m_lock { };
+    QHash<QString, QAuthPrompt::Type> m_prompts { }; ///< of the prompts not echoing the response
+    QHash<QString, QAuth::Info> m_infos { };
+};
+
+#endif // PROMPTCLASSIFIER_H
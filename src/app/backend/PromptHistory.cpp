@@ -0,0 +1,199 @@
+/*
+ * Prompt sequences learned from past conversations
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "PromptHistory.h"
+#include "config.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QUrl>
+
+#include <stdio.h>
+
+#define HISTORY_MAGIC 0x51415048
+// nobody needs that many prompts, a broken file shouldn't make us allocate more
+#define HISTORY_MAX_PROMPTS 16
+
+static Request invalidSequence { };
+
+PromptHistory::PromptHistory(const QString &service, const QString &user)
+        : m_service(service)
+        , m_user(user)
+        // whatever the name contains, it stays a single file in the cache
+        , m_path(QString("%1/%2@%3").arg(QAUTH_PROMPT_CACHE_DIR).arg(service)
+                 .arg(QString::fromLatin1(QUrl::toPercentEncoding(user))))
+        , m_stamp(configStamp(QString("%1/%2").arg(QAUTH_PAM_CONFIG_DIR).arg(service))) {
+    load();
+}
+
+const QString &PromptHistory::service() const {
+    return m_service;
+}
+
+const QString &PromptHistory::user() const {
+    return m_user;
+}
+
+const Request &PromptHistory::predict(const Prompt &first) const {
+    if (m_sequence.prompts.length() < 2 || !m_confirmed)
+        return invalidSequence;
+    const Prompt &p = m_sequence.prompts.first();
+    if (p.type != first.type || p.message != first.message || p.hidden != first.hidden)
+        return invalidSequence;
+    return m_sequence;
+}
+
+void PromptHistory::learn(const Request &observed, bool predicted) {
+    if (!observed.valid())
+        return;
+
+    // only the questions are kept, never the answers
+    Request sequence;
+    for (const Prompt &p : observed.prompts)
+        sequence.prompts << Prompt(p.type, p.message, p.hidden);
+
+    bool changed = !(sequence == m_sequence);
+    // a single prompt goes in one round trip anyway, there's nothing to predict
+    if (sequence.prompts.length() >= 2) {
+        if (predicted && !changed)
+            m_hits++;
+        else
+            m_misses++;
+    }
+    else if (!changed) {
+        return;
+    }
+    // a challenge in the messages never comes the same twice, so it's never predicted
+    m_confirmed = !changed;
+    m_sequence = sequence;
+    save();
+    qDebug() << " AUTH: PAM: Prompt history of" << m_service << "for" << m_user << "-" << m_hits << "hits," << m_misses << "misses";
+}
+
+quint64 PromptHistory::hits() const {
+    return m_hits;
+}
+
+quint64 PromptHistory::misses() const {
+    return m_misses;
+}
+
+void PromptHistory::load() {
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream str(&file);
+    str.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic = 0;
+    qint64 stamp = 0;
+    quint64 hits = 0, misses = 0;
+    Request sequence;
+    bool confirmed = false;
+    str >> magic >> stamp >> hits >> misses;
+    if (str.status() != QDataStream::Ok || magic != HISTORY_MAGIC)
+        return;
+    // the counters survive a change of the configuration, the sequence doesn't
+    m_hits = hits;
+    m_misses = misses;
+    if (stamp != m_stamp)
+        return;
+
+    quint64 length = readVarint(str);
+    for (quint64 i = 0; i < length && i < HISTORY_MAX_PROMPTS && str.status() == QDataStream::Ok; i++) {
+        Prompt p;
+        str >> p;
+        sequence.prompts << p;
+    }
+    // older helpers didn't store it, their sequences have to come once more
+    if (!str.atEnd())
+        str >> confirmed;
+    if (str.status() == QDataStream::Ok && quint64(sequence.prompts.length()) == length) {
+        m_sequence = sequence;
+        m_confirmed = confirmed;
+    }
+}
+
+/*
+ * Written next to the old one and renamed over it, readers never see half of it
+ */
+void PromptHistory::save() const {
+    if (!QDir().mkpath(QAUTH_PROMPT_CACHE_DIR))
+        return;
+
+    // multiplexed conversations of one helper can be saving at the same time
+    QString temporary = QString("%1.%2.%3").arg(m_path).arg(QCoreApplication::applicationPid()).arg(quintptr(this));
+    QFile file(temporary);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << " AUTH: PAM: Can't store the prompt history:" << file.errorString();
+        return;
+    }
+    file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+
+    QDataStream str(&file);
+    str.setByteOrder(QDataStream::LittleEndian);
+    str << quint32(HISTORY_MAGIC) << m_stamp << m_hits << m_misses << m_sequence << m_confirmed;
+    file.close();
+
+    if (str.status() != QDataStream::Ok || rename(qPrintable(temporary), qPrintable(m_path)) < 0)
+        QFile::remove(temporary);
+
+    // older helpers kept one history for everybody using the service
+    QFile::remove(QString("%1/%2").arg(QAUTH_PROMPT_CACHE_DIR).arg(m_service));
+}
+
+/*
+ * The newest modification time of the service's configuration and everything it includes
+ */
+qint64 PromptHistory::configStamp(const QString &path, int depth) {
+    QFileInfo info(path);
+    if (depth > 8 || !info.exists())
+        return 0;
+    qint64 stamp = info.lastModified().toMSecsSinceEpoch();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return stamp;
+
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        QString included;
+        if (fields[0] == "@include" && fields.length() > 1)
+            included = fields[1];
+        else if (fields.length() > 2 && (fields[1] == "include" || fields[1] == "substack"))
+            included = fields[2];
+        if (!included.isEmpty())
+            stamp = qMax(stamp, configStamp(QString("%1/%2").arg(QAUTH_PAM_CONFIG_DIR).arg(included), depth + 1));
+    }
+    return stamp;
+}
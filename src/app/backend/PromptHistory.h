@@ -0,0 +1,89 @@
+/*
+ * Prompt sequences learned from past conversations
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef PROMPTHISTORY_H
+#define PROMPTHISTORY_H
+
+#include "Messages.h"
+
+#include <QtCore/QString>
+
+/**
+ * The prompts a PAM service asked a user for the last time, to predict the next time
+ *
+ * Stacks with OTP, smartcard or custom modules ask for prompts the built-in
+ * templates of \ref PamData don't know about, each of them would need a round
+ * trip of its own. After every successful authentication the sequence of
+ * prompts is stored (without any responses) in QAUTH_PROMPT_CACHE_DIR, one
+ * file per service and user. The messages may name the user or carry
+ * challenges meant only for them, so the history of one user is never shown
+ * to anyone else. When the first prompt of the stored sequence comes again,
+ * the whole sequence is sent to the library at once. Only a sequence that
+ * came the same in two authentications in a row is predicted, messages with
+ * a challenge that changes every time (OTP) would show a stale one otherwise.
+ *
+ * The stored sequence is dropped as soon as the PAM configuration of the
+ * service (or anything it includes) is newer than the one it was learned
+ * with. Helpers running at the same time overwrite each other, the last
+ * one to finish wins.
+ */
+class PromptHistory {
+public:
+    PromptHistory(const QString &service, const QString &user);
+
+    const QString &service() const;
+    const QString &user() const;
+
+    /**
+     * @return the sequence starting with \p first, an invalid request if there's none or it isn't confirmed yet
+     */
+    const Request &predict(const Prompt &first) const;
+
+    /**
+     * Remembers what was asked in a successful authentication
+     * @param predicted true if the sequence was predicted
+     */
+    void learn(const Request &observed, bool predicted);
+
+    /**
+     * @return authentications with more prompts than one, all of them predicted
+     */
+    quint64 hits() const;
+    /**
+     * @return authentications with more prompts than one, not all of them predicted
+     */
+    quint64 misses() const;
+
+private:
+    void load();
+    void save() const;
+    static qint64 configStamp(const QString &path, int depth = 0);
+
+    QString m_service { };
+    QString m_user { };
+    QString m_path { };
+    qint64 m_stamp { 0 }; ///< of the PAM configuration right now
+    Request m_sequence { };
+    bool m_confirmed { false }; ///< \ref m_sequence came twice in a row, messages included
+    quint64 m_hits { 0 };
+    quint64 m_misses { 0 };
+};
+
+#endif // PROMPTHISTORY_H
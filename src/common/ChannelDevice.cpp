@@ -0,0 +1,135 @@
+/*
+ * One channel of a multiplexed connection
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "ChannelDevice.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <limits.h>
+#include <string.h>
+
+ChannelDevice::ChannelDevice(qint64 channel, QObject *parent)
+        : QIODevice(parent)
+        , m_channel(channel) {
+    // all the buffering happens here, QIODevice would only get in the way of the threads
+    open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+qint64 ChannelDevice::channel() const {
+    return m_channel;
+}
+
+void ChannelDevice::deliver(const QByteArray &chunk) {
+    if (chunk.isEmpty()) {
+        hangUp();
+        return;
+    }
+    {
+        QMutexLocker locker(&m_lock);
+        // drop what was read already instead of growing forever
+        if (m_readPos > 0 && m_readPos == m_incoming.length()) {
+            m_incoming.resize(0);
+            m_readPos = 0;
+        }
+        m_incoming.append(chunk);
+        m_arrived.wakeAll();
+    }
+    Q_EMIT readyRead();
+}
+
+void ChannelDevice::hangUp() {
+    {
+        QMutexLocker locker(&m_lock);
+        if (m_closed)
+            return;
+        m_closed = true;
+        m_arrived.wakeAll();
+    }
+    Q_EMIT readChannelFinished();
+}
+
+/*
+ * Tells the other side there's nothing more coming. A channel the other
+ * side closed first gets the empty chunk too, it may be waiting to know
+ * we're done with it.
+ */
+void ChannelDevice::close() {
+    {
+        QMutexLocker locker(&m_lock);
+        m_closed = true;
+        m_arrived.wakeAll();
+    }
+    if (isOpen())
+        Q_EMIT outgoing(m_channel, QByteArray());
+    QIODevice::close();
+}
+
+bool ChannelDevice::isSequential() const {
+    return true;
+}
+
+qint64 ChannelDevice::bytesAvailable() const {
+    QMutexLocker locker(&m_lock);
+    return m_incoming.length() - m_readPos + QIODevice::bytesAvailable();
+}
+
+qint64 ChannelDevice::bytesToWrite() const {
+    return m_outgoing.length();
+}
+
+bool ChannelDevice::waitForReadyRead(int msecs) {
+    QMutexLocker locker(&m_lock);
+    if (m_readPos < m_incoming.length())
+        return true;
+    if (!m_closed)
+        m_arrived.wait(&m_lock, msecs < 0 ? ULONG_MAX : (unsigned long) msecs);
+    return m_readPos < m_incoming.length();
+}
+
+bool ChannelDevice::waitForBytesWritten(int msecs) {
+    Q_UNUSED(msecs);
+    if (m_outgoing.isEmpty())
+        return false;
+    QByteArray chunk = m_outgoing;
+    m_outgoing.clear();
+    Q_EMIT outgoing(m_channel, chunk);
+    Q_EMIT bytesWritten(chunk.length());
+    return true;
+}
+
+qint64 ChannelDevice::readData(char *data, qint64 maxSize) {
+    QMutexLocker locker(&m_lock);
+    qint64 length = qMin(maxSize, qint64(m_incoming.length() - m_readPos));
+    if (length <= 0)
+        return m_closed ? -1 : 0;
+    memcpy(data, m_incoming.constData() + m_readPos, length);
+    m_readPos += length;
+    return length;
+}
+
+qint64 ChannelDevice::writeData(const char *data, qint64 maxSize) {
+    QMutexLocker locker(&m_lock);
+    if (m_closed)
+        return -1;
+    m_outgoing.append(data, maxSize);
+    return maxSize;
+}
+
+#include "ChannelDevice.moc"
@@ -0,0 +1,81 @@
+/*
+ * One channel of a multiplexed connection
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef CHANNELDEVICE_H
+#define CHANNELDEVICE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QIODevice>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+/**
+ * Byte stream of one conversation carried over a shared connection
+ *
+ * Every frame of a multiplexed connection is the channel ID followed by
+ * a chunk of that channel's stream. The owner of the connection feeds the
+ * chunks with \ref deliver, a SafeDataStream on top of the device reads its
+ * frames out of them as if it had the connection for itself. Everything
+ * written is collected and handed over as one chunk by \ref outgoing when
+ * \ref waitForBytesWritten is called, which SafeDataStream does after
+ * every frame. An empty chunk closes the channel, \ref close sends one.
+ *
+ * \ref deliver and \ref hangUp can be called from another thread than the
+ * reading one, \ref waitForReadyRead blocks until they do.
+ */
+class ChannelDevice : public QIODevice {
+    Q_OBJECT
+public:
+    explicit ChannelDevice(qint64 channel, QObject *parent = 0);
+
+    qint64 channel() const;
+
+    void deliver(const QByteArray &chunk);
+    void hangUp();
+
+    void close();
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+    qint64 bytesToWrite() const;
+    bool waitForReadyRead(int msecs);
+    bool waitForBytesWritten(int msecs);
+
+signals:
+    /**
+     * Emitted in the thread writing to the device, the connection has to be
+     * either direct or queued to the thread owning the shared connection
+     */
+    void outgoing(qint64 channel, const QByteArray &chunk);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    qint64 m_channel { 0 };
+    mutable QMutex m_lock { };
+    QWaitCondition m_arrived { };
+    QByteArray m_incoming { };
+    int m_readPos { 0 };
+    bool m_closed { false };
+    QByteArray m_outgoing { };
+};
+
+#endif // CHANNELDEVICE_H
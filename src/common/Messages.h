@@ -22,9 +22,28 @@
 #define MESSAGES_H
 
 #include <QtCore/QDataStream>
+#include <QtCore/QIODevice>
 #include <QtCore/QProcessEnvironment>
+#include <QtCore/QStringList>
 
 #include "lib/qauth.h"
+#include "Wire.h"
+
+/*
+ * Secrets are only ever wiped by their owner: writing through data() of
+ * a shared array would detach it and zero a fresh copy instead. Whoever takes
+ * a secret over makes a deep copy of its own, never shares it and wipes it
+ * with wipeSecret.
+ */
+inline QByteArray ownedCopy(const QByteArray &secret) {
+    return QByteArray(secret.constData(), secret.size());
+}
+
+inline void wipeSecret(QByteArray &secret) {
+    if (secret.isDetached())
+        memset(secret.data(), 0, secret.size());
+    secret.clear();
+}
 
 class Prompt {
 public:
@@ -88,26 +107,111 @@ public:
     QList<Prompt> prompts { };
 };
 
-enum Msg {
-    MSG_UNKNOWN = 0,
-    HELLO = 1,
-    ERROR,
-    INFO,
-    REQUEST,
-    AUTHENTICATED,
-    SESSION_STATUS,
-    MSG_LAST,
+/*
+ * Only v2 streams are little-endian, so the operators below can tell
+ * which encoding to use without knowing anything about the connection
+ */
+inline bool compact(const QDataStream &s) {
+    return s.byteOrder() == QDataStream::LittleEndian;
+}
+
+inline void writeVarint(QDataStream &s, quint64 value) {
+    char bytes[WIRE_MAX_VARINT_SIZE];
+    s.writeRawData(bytes, encodeVarint(value, bytes));
+}
+
+inline quint64 readVarint(QDataStream &s) {
+    uint64_t value = 0;
+    bool ok = decodeVarint([&s]() -> int {
+        quint8 byte = 0;
+        s >> byte;
+        return s.status() == QDataStream::Ok ? byte : -1;
+    }, &value);
+    if (!ok) {
+        // running out of data says so already
+        if (s.status() == QDataStream::Ok)
+            s.setStatus(QDataStream::ReadCorruptData);
+        return 0;
+    }
+    return value;
+}
+
+inline void writeBytes(QDataStream &s, const QByteArray &bytes) {
+    writeVarint(s, bytes.length());
+    s.writeRawData(bytes.constData(), bytes.length());
+}
+
+inline QByteArray readBytes(QDataStream &s) {
+    quint64 length = readVarint(s);
+    // don't let a broken length allocate more than what's actually there
+    if (s.status() != QDataStream::Ok || length > quint64(s.device()->bytesAvailable())) {
+        s.setStatus(QDataStream::ReadPastEnd);
+        return QByteArray();
+    }
+    QByteArray bytes(int(length), Qt::Uninitialized);
+    s.readRawData(bytes.data(), bytes.length());
+    return bytes;
+}
+
+/**
+ * String as it goes over the wire: UTF-16 QString in v1, UTF-8 in v2
+ *
+ * Usage: str << WireString(message) or str >> WireString(message)
+ */
+class WireString {
+public:
+    WireString(const QString &string)
+            : in(&string) { }
+    WireString(QString &string)
+            : in(&string), out(&string) { }
+
+    const QString *in { nullptr };
+    QString *out { nullptr };
 };
 
+inline QDataStream& operator<<(QDataStream &s, const WireString &m) {
+    if (compact(s))
+        writeBytes(s, m.in->toUtf8());
+    else
+        s << *m.in;
+    return s;
+}
+
+inline QDataStream& operator>>(QDataStream &s, const WireString &m) {
+    if (compact(s))
+        *m.out = QString::fromUtf8(readBytes(s));
+    else
+        s >> *m.out;
+    return s;
+}
+
+/*
+ * Enums are varints in v2, they always fit in a single byte
+ */
+inline void writeEnum(QDataStream &s, qint32 value) {
+    if (compact(s))
+        writeVarint(s, quint32(value));
+    else
+        s << value;
+}
+
+inline qint32 readEnum(QDataStream &s) {
+    qint32 i = 0;
+    if (compact(s))
+        i = qint32(readVarint(s));
+    else
+        s >> i;
+    return i;
+}
+
 inline QDataStream& operator<<(QDataStream &s, const Msg &m) {
-    s << qint32(m);
+    writeEnum(s, m);
     return s;
 }
 
 inline QDataStream& operator>>(QDataStream &s, Msg &m) {
     // TODO seriously?
-    qint32 i;
-    s >> i;
+    qint32 i = readEnum(s);
     if (i >= MSG_LAST || i <= MSG_UNKNOWN) {
         s.setStatus(QDataStream::ReadCorruptData);
         return s;
@@ -117,14 +221,13 @@ inline QDataStream& operator>>(QDataStream &s, Msg &m) {
 }
 
 inline QDataStream& operator<<(QDataStream &s, const QAuth::Error &m) {
-    s << qint32(m);
+    writeEnum(s, m);
     return s;
 }
 
 inline QDataStream& operator>>(QDataStream &s, QAuth::Error &m) {
     // TODO seriously?
-    qint32 i;
-    s >> i;
+    qint32 i = readEnum(s);
     if (i >= QAuth::_ERROR_LAST || i < QAuth::ERROR_NONE) {
         s.setStatus(QDataStream::ReadCorruptData);
         return s;
@@ -134,14 +237,13 @@ inline QDataStream& operator>>(QDataStream &s, QAuth::Error &m) {
 }
 
 inline QDataStream& operator<<(QDataStream &s, const QAuth::Info &m) {
-    s << qint32(m);
+    writeEnum(s, m);
     return s;
 }
 
 inline QDataStream& operator>>(QDataStream &s, QAuth::Info &m) {
     // TODO seriously?
-    qint32 i;
-    s >> i;
+    qint32 i = readEnum(s);
     if (i >= QAuth::_INFO_LAST || i < QAuth::INFO_NONE) {
         s.setStatus(QDataStream::ReadCorruptData);
         return s;
@@ -151,11 +253,27 @@ inline QDataStream& operator>>(QDataStream &s, QAuth::Info &m) {
 }
 
 inline QDataStream& operator<<(QDataStream &s, const QProcessEnvironment &m) {
+    if (compact(s)) {
+        QStringList keys = m.keys();
+        writeVarint(s, keys.length());
+        for (const QString &key : keys)
+            s << WireString(key) << WireString(m.value(key));
+        return s;
+    }
     s << m.toStringList();
     return s;
 }
 
 inline QDataStream& operator>>(QDataStream &s, QProcessEnvironment &m) {
+    if (compact(s)) {
+        quint64 length = readVarint(s);
+        for (quint64 i = 0; i < length && s.status() == QDataStream::Ok; i++) {
+            QString key, value;
+            s >> WireString(key) >> WireString(value);
+            m.insert(key, value);
+        }
+        return s;
+    }
     QStringList l;
     s >> l;
     for (QString s : l) {
@@ -166,6 +284,12 @@ inline QDataStream& operator>>(QDataStream &s, QProcessEnvironment &m) {
 }
 
 inline QDataStream& operator<<(QDataStream &s, const Prompt &m) {
+    if (compact(s)) {
+        writeEnum(s, m.type);
+        s << WireString(m.message) << m.hidden;
+        writeBytes(s, m.response);
+        return s;
+    }
     s << qint32(m.type) << m.message << m.hidden << m.response;
     return s;
 }
@@ -175,7 +299,14 @@ inline QDataStream& operator>>(QDataStream &s, Prompt &m) {
     QString message;
     bool hidden;
     QByteArray response;
-    s >> type >> message >> hidden >> response;
+    if (compact(s)) {
+        type = readEnum(s);
+        s >> WireString(message) >> hidden;
+        response = readBytes(s);
+    }
+    else {
+        s >> type >> message >> hidden >> response;
+    }
     m.type = QAuthPrompt::Type(type);
     m.message = message;
     m.hidden = hidden;
@@ -185,7 +316,10 @@ inline QDataStream& operator>>(QDataStream &s, Prompt &m) {
 
 inline QDataStream& operator<<(QDataStream &s, const Request &m) {
     qint32 length = m.prompts.length();
-    s << length;
+    if (compact(s))
+        writeVarint(s, length);
+    else
+        s << length;
     Q_FOREACH(Prompt p, m.prompts) {
         s << p;
     }
@@ -195,8 +329,11 @@ inline QDataStream& operator<<(QDataStream &s, const Request &m) {
 inline QDataStream& operator>>(QDataStream &s, Request &m) {
     QList<Prompt> prompts;
     qint32 length;
-    s >> length;
-    for (int i = 0; i < length; i++) {
+    if (compact(s))
+        length = qint32(readVarint(s));
+    else
+        s >> length;
+    for (int i = 0; i < length && s.status() == QDataStream::Ok; i++) {
         Prompt p;
         s >> p;
         prompts << p;
@@ -209,4 +346,60 @@ inline QDataStream& operator>>(QDataStream &s, Request &m) {
     return s;
 }
 
+/**
+ * Reply to a REQUEST
+ *
+ * v1 sends the whole request back, v2 only the responses keyed by the index
+ * of their prompt. The helper still has the rest, so it reads the reply into
+ * a copy of what it sent.
+ */
+class Responses {
+public:
+    Responses(const Request &request)
+            : in(&request) { }
+    Responses(Request &request)
+            : in(&request), out(&request) { }
+
+    const Request *in { nullptr };
+    Request *out { nullptr };
+};
+
+inline QDataStream& operator<<(QDataStream &s, const Responses &m) {
+    if (!compact(s)) {
+        s << *m.in;
+        return s;
+    }
+    qint32 count = 0;
+    for (const Prompt &p : m.in->prompts) {
+        if (!p.response.isEmpty())
+            count++;
+    }
+    writeVarint(s, count);
+    for (int i = 0; i < m.in->prompts.length(); i++) {
+        if (m.in->prompts[i].response.isEmpty())
+            continue;
+        writeVarint(s, i);
+        writeBytes(s, m.in->prompts[i].response);
+    }
+    return s;
+}
+
+inline QDataStream& operator>>(QDataStream &s, const Responses &m) {
+    if (!compact(s)) {
+        s >> *m.out;
+        return s;
+    }
+    quint64 count = readVarint(s);
+    for (quint64 i = 0; i < count && s.status() == QDataStream::Ok; i++) {
+        quint64 index = readVarint(s);
+        QByteArray response = readBytes(s);
+        if (index >= quint64(m.out->prompts.length())) {
+            s.setStatus(QDataStream::ReadCorruptData);
+            return s;
+        }
+        m.out->prompts[index].response = response;
+    }
+    return s;
+}
+
 #endif // MESSAGES_H
\ No newline at end of file
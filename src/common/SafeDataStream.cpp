@@ -21,61 +21,241 @@
 #include "SafeDataStream.h"
 
 #include <QtCore/QDebug>
+#include <QtNetwork/QLocalSocket>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/*
+ * Zeroes the beginning of a buffer, without detaching an empty one for nothing
+ */
+static void wipe(QByteArray &buffer, qint64 length) {
+    if (length > 0)
+        memset(buffer.data(), 0, length);
+}
 
 SafeDataStream::SafeDataStream(QIODevice* device)
-        : QDataStream(&m_data, QIODevice::ReadWrite)
-        , m_device(device) { }
+        : QDataStream()
+        , m_device(device) {
+    m_buffer.setBuffer(&m_data);
+    m_buffer.open(QIODevice::ReadWrite);
+    setDevice(&m_buffer);
+}
+
+SafeDataStream::~SafeDataStream() {
+    // whatever was sent or received last, or a frame that never made it
+    m_buffer.close();
+    wipe(m_data, m_data.size());
+    wipe(m_input, m_input.size());
+}
+
+void SafeDataStream::setProtocol(int protocol) {
+    m_protocol = protocol;
+    setByteOrder(protocol >= PROTOCOL_V2 ? QDataStream::LittleEndian : QDataStream::BigEndian);
+}
+
+int SafeDataStream::protocol() const {
+    return m_protocol;
+}
+
+int SafeDataStream::headerSize() const {
+    return m_protocol >= PROTOCOL_V2 ? WIRE_HEADER_SIZE : sizeof(qint64);
+}
 
 void SafeDataStream::send() {
-    qint64 length = m_data.length();
-    qint64 writtenTotal = 0;
+    qint64 length = m_buffer.pos();
+    char header[sizeof(qint64)];
+    bool sent;
+
+    if (m_protocol >= PROTOCOL_V2)
+        encodeFrameLength(quint32(length), header);
+    else
+        memcpy(header, &length, sizeof(length));
+
     if (!m_device->isOpen()) {
         qCritical() << " QAuth: SafeDataStream: Could not write any data";
+        reset();
         return;
     }
-    m_device->write((const char*) &length, sizeof(length));
-    while (writtenTotal != length) {
-        qint64 written = m_device->write(m_data.mid(writtenTotal));
-        if (written < 0 || !m_device->isOpen()) {
-            qCritical() << " QAuth: SafeDataStream: Could not write all stored data";
-            return;
-        }
-        writtenTotal += written;
-        m_device->waitForBytesWritten(-1);
+    // the other side wouldn't accept it anyway
+    if (length > WIRE_MAX_FRAME_SIZE) {
+        qCritical() << " QAuth: SafeDataStream: Message too long:" << length;
+        reset();
+        return;
     }
 
+    // anything Qt still has queued has to go out first to keep the order
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(m_device);
+    if (socket && int(socket->socketDescriptor()) >= 0 && socket->bytesToWrite() == 0)
+        sent = writeSocket(int(socket->socketDescriptor()), header, length);
+    else
+        sent = writeDevice(header, length);
+
+    if (!sent)
+        qCritical() << " QAuth: SafeDataStream: Could not write all stored data";
+
     reset();
 }
 
-void SafeDataStream::receive() {
-    qint64 length = -1;
+/*
+ * Header and payload in one syscall, partial writes only move the pointers
+ * (sendmsg instead of writev only to avoid SIGPIPE)
+ */
+bool SafeDataStream::writeSocket(int fd, const char *header, qint64 length) {
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(header);
+    iov[0].iov_len = headerSize();
+    iov[1].iov_base = m_data.data();
+    iov[1].iov_len = length;
 
-    if (!m_device->isOpen()) {
-        qCritical() << " QAuth: SafeDataStream: Could not read from the device";
-        return;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    while (msg.msg_iovlen > 0) {
+        ssize_t written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { fd, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return false;
+        }
+        while (msg.msg_iovlen > 0 && (size_t) written >= msg.msg_iov->iov_len) {
+            written -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char*) msg.msg_iov->iov_base + written;
+            msg.msg_iov->iov_len -= written;
+        }
     }
-    if (!m_device->bytesAvailable())
-        m_device->waitForReadyRead(-1);
-    m_device->read((char*) &length, sizeof(length));
+    return true;
+}
 
-    if (length < 0)
-        return;
-    reset();
+bool SafeDataStream::writeDevice(const char *header, qint64 length) {
+    qint64 writtenTotal = 0;
+    if (m_device->write(header, headerSize()) != headerSize())
+        return false;
+    while (writtenTotal != length) {
+        qint64 written = m_device->write(m_data.constData() + writtenTotal, length - writtenTotal);
+        if (written < 0 || !m_device->isOpen())
+            return false;
+        writtenTotal += written;
+    }
+    m_device->waitForBytesWritten(-1);
+    return true;
+}
 
-    while (m_data.length() < length) {
-        if (!m_device->isOpen()) {
+/*
+ * Blocks until a whole frame arrives, continuing any frame \ref tryReceive started
+ */
+void SafeDataStream::receive() {
+    while (!tryReceive()) {
+        if (status() != QDataStream::Ok || !m_device->isOpen()) {
             qCritical() << " QAuth: SafeDataStream: Could not read from the device";
             return;
         }
-        if (!m_device->bytesAvailable())
-            m_device->waitForReadyRead(-1);
-        m_data.append(m_device->read(length - m_data.length()));
+        if (!m_device->waitForReadyRead(-1)) {
+            qCritical() << " QAuth: SafeDataStream: Connection lost in the middle of a message";
+            return;
+        }
+    }
+}
+
+bool SafeDataStream::tryReceive() {
+    // an empty frame until we have a complete one, nothing old can be read by accident
+    setFrame(0);
+
+    if (!m_device->isOpen())
+        return false;
+
+    if (m_length < 0) {
+        qint64 read = m_device->read(m_header + m_headerRead, headerSize() - m_headerRead);
+        if (read <= 0)
+            return false;
+        m_headerRead += read;
+        if (m_headerRead < headerSize())
+            return false;
+
+        m_headerRead = 0;
+        if (m_protocol >= PROTOCOL_V2)
+            m_length = decodeFrameLength(m_header);
+        else
+            memcpy(&m_length, m_header, sizeof(m_length));
+        if (m_length < 0 || m_length > WIRE_MAX_FRAME_SIZE) {
+            qCritical() << " QAuth: SafeDataStream: Received an invalid frame length" << m_length;
+            // there's no telling where the next frame starts, nothing more can be read
+            m_length = -1;
+            m_device->close();
+            setStatus(QDataStream::ReadCorruptData);
+            return false;
+        }
+        m_payloadRead = 0;
+        if (qint64(m_input.size()) < m_length)
+            m_input.resize(int(qMin(qMax(m_length, 2 * qint64(m_input.size())), qint64(WIRE_MAX_FRAME_SIZE))));
+    }
+
+    while (m_payloadRead < m_length) {
+        qint64 read = m_device->read(m_input.data() + m_payloadRead, m_length - m_payloadRead);
+        if (read <= 0)
+            return false;
+        m_payloadRead += read;
     }
+
+    setFrame(m_length);
+    m_length = -1;
+    return true;
 }
 
+/*
+ * Writing a reply ends the frame too, the rest of it would be lost anyway
+ */
+bool SafeDataStream::atFrameEnd() const {
+    return &m_buffer.buffer() != &m_frame || m_buffer.atEnd() || status() != QDataStream::Ok;
+}
+
+/*
+ * The previous frame has been read by now, the secrets in it go away
+ * before anything else is received over them
+ */
+void SafeDataStream::setFrame(qint64 length) {
+    // so does a message that was written but never sent
+    if (&m_buffer.buffer() == &m_data)
+        wipe(m_data, m_buffer.pos());
+    m_buffer.close();
+    wipe(m_input, m_frame.size());
+    m_frame = QByteArray::fromRawData(m_input.constData(), length);
+    m_buffer.setBuffer(&m_frame);
+    // QIODevice would keep its own copy of what's read otherwise
+    m_buffer.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    resetStatus();
+}
+
+/*
+ * Prepares the stream for writing a new message, the allocated buffer stays
+ * but neither the message written before nor the frame received is left in it
+ */
 void SafeDataStream::reset() {
-    m_data.clear();
-    device()->reset();
+    if (&m_buffer.buffer() != &m_data) {
+        m_buffer.close();
+        wipe(m_input, m_frame.size());
+        m_frame = QByteArray();
+        m_buffer.setBuffer(&m_data);
+        m_buffer.open(QIODevice::ReadWrite);
+    }
+    else {
+        wipe(m_data, m_buffer.pos());
+    }
+    m_buffer.seek(0);
     resetStatus();
 }
 
@@ -21,17 +21,64 @@
 #ifndef SAFEDATASTREAM_H
 #define SAFEDATASTREAM_H
 
+#include <QtCore/QBuffer>
 #include <QtCore/QDataStream>
 
+#include "Messages.h"
+
+/**
+ * Length-prefixed frames over a socket
+ *
+ * Meant to be kept for the whole lifetime of the connection: the buffer only
+ * grows and gets reused by every following frame, so a steady conversation
+ * doesn't allocate at all. Sockets get the header and the payload in
+ * a single gather write, received payloads are read straight into the buffer.
+ *
+ * Frames can be received either blocking with \ref receive or piece by piece
+ * with \ref tryReceive, which never waits and keeps partial frames between calls.
+ *
+ * Credentials pass through the buffers, so a frame is wiped as soon as it's
+ * been sent, and a received one as soon as the next frame or a reply starts.
+ */
 class SafeDataStream : public QDataStream {
 public:
     SafeDataStream(QIODevice* device);
+    ~SafeDataStream();
     void send();
     void receive();
+    /**
+     * Reads whatever the device has available without waiting
+     * @return true if a whole frame is ready to be read from the stream
+     */
+    bool tryReceive();
+    /**
+     * @return false if another message follows in the received frame
+     */
+    bool atFrameEnd() const;
     void reset();
 
+    /**
+     * Switches the header and the encoding of the values, see \ref Protocol.
+     * Only to be called between frames.
+     */
+    void setProtocol(int protocol);
+    int protocol() const;
+
 private:
-    QByteArray m_data { };
+    int headerSize() const;
+    bool writeSocket(int fd, const char *header, qint64 length);
+    bool writeDevice(const char *header, qint64 length);
+    void setFrame(qint64 length);
+
+    QByteArray m_data { }; ///< outgoing frame, never shrinks, only the beginning is valid
+    QByteArray m_input { }; ///< incoming frame, separate so replies can't overwrite a partial one
+    QByteArray m_frame { }; ///< view of the received part of \ref m_input
+    char m_header[sizeof(qint64)];
+    int m_headerRead { 0 };
+    qint64 m_length { -1 }; ///< of the incoming frame, -1 while the header is incomplete
+    qint64 m_payloadRead { 0 };
+    int m_protocol { PROTOCOL_V1 };
+    QBuffer m_buffer { };
     QIODevice *m_device { nullptr };
 };
 
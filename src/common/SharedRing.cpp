@@ -0,0 +1,481 @@
+/*
+ * Connection through a pair of ring buffers in shared memory
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "SharedRing.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QStringList>
+
+#include <atomic>
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#define RING_MAGIC 0x51415552
+#define RING_SIZE (64 * 1024)
+// how often the waiting side checks if the other one is still alive
+#define RING_POLL_INTERVAL 100
+
+struct SharedRing::Ring {
+    std::atomic<quint64> head; ///< bytes written so far, only moved by the writer
+    std::atomic<quint64> tail; ///< bytes read so far, only moved by the reader
+    std::atomic<quint32> readerWaiting; ///< the reader wants its bell rung on new data
+    std::atomic<quint32> writerWaiting; ///< the writer wants its bell rung on free space
+};
+
+struct SharedRing::Header {
+    quint32 magic;
+    quint32 size; ///< of each ring
+    Ring rings[2]; ///< indexed by the \ref Side writing into it
+    std::atomic<qint32> pids[2];
+    std::atomic<quint32> closed[2];
+};
+
+SharedRing::SharedRing(Side side, QObject *parent)
+        : QIODevice(parent)
+        , m_side(side) {
+    open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+SharedRing::~SharedRing() {
+    close();
+    if (m_header)
+        munmap(m_header, m_mapped);
+    if (m_memfd >= 0)
+        ::close(m_memfd);
+    if (m_bell >= 0)
+        ::close(m_bell);
+    if (m_peerBell >= 0)
+        ::close(m_peerBell);
+}
+
+SharedRing *SharedRing::create(QList<int> *childFds, QObject *parent) {
+    int memfd = -1;
+#ifdef SYS_memfd_create
+    memfd = syscall(SYS_memfd_create, "qauth-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    errno = ENOSYS;
+#endif
+    if (memfd < 0) {
+        qWarning() << " QAuth: SharedRing: memfd_create:" << strerror(errno);
+        return nullptr;
+    }
+
+    SharedRing *ring = new SharedRing(LIBRARY, parent);
+    ring->m_memfd = memfd;
+    ring->m_bell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ring->m_peerBell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->m_bell < 0 || ring->m_peerBell < 0 || !ring->map(memfd, true)) {
+        qWarning() << " QAuth: SharedRing: Could not set up the shared memory:" << strerror(errno);
+        delete ring;
+        return nullptr;
+    }
+
+    // the helper gets its own copies, ours stay open after the caller closes them
+    int fds[3] = {
+        fcntl(memfd, F_DUPFD_CLOEXEC, 0),
+        fcntl(ring->m_peerBell, F_DUPFD_CLOEXEC, 0),
+        fcntl(ring->m_bell, F_DUPFD_CLOEXEC, 0)
+    };
+    if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0) {
+        qWarning() << " QAuth: SharedRing: dup:" << strerror(errno);
+        for (int fd : fds) {
+            if (fd >= 0)
+                ::close(fd);
+        }
+        delete ring;
+        return nullptr;
+    }
+    for (int fd : fds)
+        *childFds << fd;
+    ring->m_address = QString("%1,%2,%3").arg(fds[0]).arg(fds[1]).arg(fds[2]);
+    ring->watch();
+    return ring;
+}
+
+SharedRing *SharedRing::attach(const QString &address, QObject *parent) {
+    QStringList fds = address.split(',');
+    if (fds.length() != 3) {
+        qCritical() << " QAuth: SharedRing: Invalid address:" << address;
+        return nullptr;
+    }
+
+    SharedRing *ring = new SharedRing(HELPER, parent);
+    ring->m_memfd = fds[0].toInt();
+    ring->m_bell = fds[1].toInt();
+    ring->m_peerBell = fds[2].toInt();
+    ring->m_address = address;
+    if (!ring->map(ring->m_memfd, false)) {
+        qCritical() << " QAuth: SharedRing: Could not map the shared memory:" << strerror(errno);
+        delete ring;
+        return nullptr;
+    }
+    ring->watch();
+    return ring;
+}
+
+/*
+ * The library lays out a fresh region, the helper only checks it's what it expects
+ */
+bool SharedRing::map(int memfd, bool initialize) {
+    // keep the data away from the cache lines of the counters
+    size_t offset = (sizeof(Header) + 63) & ~size_t(63);
+    size_t length = offset + 2 * RING_SIZE;
+
+    if (initialize) {
+        if (ftruncate(memfd, length) < 0)
+            return false;
+#ifdef F_ADD_SEALS
+        // the helper can't make our mapping fault by shrinking it
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+    }
+    else {
+        struct stat st;
+        if (fstat(memfd, &st) < 0)
+            return false;
+        length = st.st_size;
+        if (length < offset) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (memory == MAP_FAILED)
+        return false;
+    m_header = static_cast<Header*>(memory);
+    m_mapped = length;
+
+    if (initialize) {
+        new (memory) Header();
+        m_header->magic = RING_MAGIC;
+        m_header->size = RING_SIZE;
+        // nobody has read anything yet, the first data has to wake the reader up
+        m_header->rings[LIBRARY].readerWaiting = 1;
+        m_header->rings[HELPER].readerWaiting = 1;
+        m_size = RING_SIZE;
+    }
+    else {
+        m_size = m_header->size;
+        if (m_header->magic != RING_MAGIC || m_size == 0 || offset + 2 * m_size > length) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+    m_header->pids[m_side] = getpid();
+
+    Side peer = m_side == LIBRARY ? HELPER : LIBRARY;
+    char *data = static_cast<char*>(memory) + offset;
+    m_outRing = &m_header->rings[m_side];
+    m_inRing = &m_header->rings[peer];
+    m_out = data + m_side * m_size;
+    m_in = data + peer * m_size;
+    // the library may have written something before the helper got here
+    m_written = m_outRing->head.load();
+    m_read = m_inRing->tail.load();
+    return true;
+}
+
+void SharedRing::watch() {
+    m_notifier = new QSocketNotifier(m_bell, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(bellRung()));
+}
+
+QString SharedRing::address() const {
+    return m_address;
+}
+
+/*
+ * Tells the other side there's nothing more coming
+ */
+void SharedRing::close() {
+    if (m_header && isOpen() && !m_header->closed[m_side].exchange(1))
+        ring(m_peerBell);
+    QIODevice::close();
+}
+
+bool SharedRing::isSequential() const {
+    return true;
+}
+
+qint64 SharedRing::bytesAvailable() const {
+    return available() + QIODevice::bytesAvailable();
+}
+
+qint64 SharedRing::bytesToWrite() const {
+    return m_pending.size();
+}
+
+/*
+ * Finding the ring empty means asking to be woken up, checking again
+ * afterwards makes sure no data slipped in before the writer could see it
+ */
+qint64 SharedRing::available() const {
+    if (m_corrupt)
+        return 0;
+    quint64 head = m_inRing->head.load(std::memory_order_acquire);
+    if (head == m_read) {
+        m_inRing->readerWaiting.store(1);
+        head = m_inRing->head.load();
+    }
+    // wraps around when the head went backwards
+    if (head - m_read > m_size) {
+        corrupted();
+        return 0;
+    }
+    return head - m_read;
+}
+
+/*
+ * Nothing that comes through the ring can be trusted anymore
+ */
+void SharedRing::corrupted() const {
+    if (!m_corrupt)
+        qCritical() << " QAuth: SharedRing: The other side broke the ring, closing";
+    m_corrupt = true;
+}
+
+bool SharedRing::peerClosed() const {
+    return m_corrupt || m_header->closed[m_side == LIBRARY ? HELPER : LIBRARY].load();
+}
+
+/*
+ * A crashed process can't say it's closing, its pid is checked too
+ */
+bool SharedRing::peerGone() const {
+    if (peerClosed())
+        return true;
+    pid_t pid = m_header->pids[m_side == LIBRARY ? HELPER : LIBRARY].load();
+    return pid > 0 && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+void SharedRing::ring(int fd) {
+    quint64 one = 1;
+    // a full counter means it's been rung already
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        qWarning() << " QAuth: SharedRing: Could not notify the other side:" << strerror(errno);
+}
+
+/*
+ * Rings the reader only when it sleeps, one syscall per frame at most
+ */
+void SharedRing::notify() {
+    if (m_outRing->readerWaiting.load() && m_outRing->readerWaiting.exchange(0))
+        ring(m_peerBell);
+}
+
+/*
+ * Sleeps until our bell rings, @return false on timeout or when the other side is gone
+ */
+bool SharedRing::wait(int msecs) {
+    QElapsedTimer timer;
+    timer.start();
+    forever {
+        if (peerGone())
+            return false;
+        int interval = RING_POLL_INTERVAL;
+        if (msecs >= 0) {
+            qint64 left = msecs - timer.elapsed();
+            if (left <= 0)
+                return false;
+            interval = qMin<qint64>(interval, left);
+        }
+        struct pollfd pfd = { m_bell, POLLIN, 0 };
+        int ret = poll(&pfd, 1, interval);
+        if (ret > 0) {
+            quint64 count;
+            // it's non-blocking, someone else might have reset it already
+            if (read(m_bell, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                return false;
+            return true;
+        }
+        if (ret < 0 && errno != EINTR)
+            return false;
+    }
+}
+
+bool SharedRing::waitForReadyRead(int msecs) {
+    QElapsedTimer timer;
+    timer.start();
+    while (available() == 0) {
+        int left = -1;
+        if (msecs >= 0) {
+            left = msecs - timer.elapsed();
+            if (left <= 0)
+                return false;
+        }
+        if (!wait(left))
+            return available() > 0;
+    }
+    return true;
+}
+
+/*
+ * Everything is in the ring already, only the reader might need waking up.
+ * What the library couldn't fit in goes out once the reader makes space,
+ * it's not waited for.
+ */
+bool SharedRing::waitForBytesWritten(int msecs) {
+    Q_UNUSED(msecs);
+    flushPending();
+    notify();
+    return true;
+}
+
+void SharedRing::bellRung() {
+    quint64 count;
+    if (read(m_bell, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        return;
+    // the reader might have made space for what's queued
+    flushPending();
+    if (available() > 0)
+        Q_EMIT readyRead();
+    else if (peerClosed())
+        Q_EMIT readChannelFinished();
+}
+
+qint64 SharedRing::readData(char *data, qint64 maxSize) {
+    qint64 length = qMin(maxSize, available());
+    if (length <= 0)
+        return peerClosed() ? -1 : 0;
+
+    // available() made sure the length fits in the ring
+    size_t pos = m_read % m_size;
+    size_t first = qMin<size_t>(length, m_size - pos);
+    memcpy(data, m_in + pos, first);
+    memcpy(data + first, m_in, length - first);
+    m_read += length;
+    m_inRing->tail.store(m_read);
+
+    if (m_inRing->writerWaiting.load() && m_inRing->writerWaiting.exchange(0))
+        ring(m_peerBell);
+    return length;
+}
+
+/*
+ * Copies as much as fits right now, @return -1 if the ring is broken
+ */
+qint64 SharedRing::put(const char *data, qint64 maxSize) {
+    if (m_corrupt)
+        return -1;
+    quint64 tail = m_outRing->tail.load(std::memory_order_acquire);
+    // the reader can't have read more than we wrote
+    if (m_written - tail > m_size) {
+        corrupted();
+        return -1;
+    }
+    qint64 length = qMin<qint64>(m_size - (m_written - tail), maxSize);
+    if (length == 0)
+        return 0;
+
+    size_t pos = m_written % m_size;
+    size_t first = qMin<size_t>(length, m_size - pos);
+    memcpy(m_out + pos, data, first);
+    memcpy(m_out, data + first, length - first);
+    m_written += length;
+    m_outRing->head.store(m_written);
+    return length;
+}
+
+/*
+ * Moves the queued data of the library into the ring, as much as fits
+ */
+void SharedRing::flushPending() {
+    bool waiting = false;
+    while (!m_pending.isEmpty()) {
+        qint64 length = put(m_pending.constData(), m_pending.size());
+        if (length < 0) {
+            m_pending.clear();
+            break;
+        }
+        if (length == 0) {
+            if (waiting)
+                break;
+            // asking to be rung and trying once more, so space made in between isn't missed
+            m_outRing->writerWaiting.store(1);
+            waiting = true;
+            continue;
+        }
+        m_pending.remove(0, int(length));
+    }
+    notify();
+}
+
+/*
+ * The helper copies as much as fits and waits for the reader to make space
+ * for the rest. The library never waits, see \ref flushPending.
+ */
+qint64 SharedRing::writeData(const char *data, qint64 maxSize) {
+    if (m_side == LIBRARY) {
+        if (peerGone())
+            return -1;
+        qint64 written = 0;
+        // queued data goes first to keep the order
+        if (m_pending.isEmpty()) {
+            written = put(data, maxSize);
+            if (written < 0)
+                return -1;
+        }
+        if (written < maxSize) {
+            m_pending.append(data + written, int(maxSize - written));
+            flushPending();
+        }
+        return maxSize;
+    }
+
+    qint64 written = 0;
+    while (written < maxSize) {
+        quint64 tail = m_outRing->tail.load();
+        qint64 length = put(data + written, maxSize - written);
+        if (length < 0)
+            return written > 0 ? written : -1;
+        if (length == 0) {
+            // the reader can't make space without knowing there's something to read
+            notify();
+            m_outRing->writerWaiting.store(1);
+            if (m_outRing->tail.load() == tail && !wait(-1))
+                return written > 0 ? written : -1;
+            continue;
+        }
+        written += length;
+    }
+    return written;
+}
+
+#include "SharedRing.moc"
@@ -0,0 +1,129 @@
+/*
+ * Connection through a pair of ring buffers in shared memory
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef SHAREDRING_H
+#define SHAREDRING_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QIODevice>
+#include <QtCore/QList>
+
+class QSocketNotifier;
+
+/**
+ * Connection between the library and a helper through shared memory
+ *
+ * A memfd holds one ring buffer for each direction. Frames are copied
+ * straight into the ring of the writer and out of it by the reader, there's
+ * no syscall per write. Each side has an eventfd it sleeps on, the other side
+ * only rings it when the sleeper said it's waiting for data or for space,
+ * which is rarely the case when the traffic is steady.
+ *
+ * The library creates the rings with \ref create and passes the descriptors
+ * to the helper it spawns, which picks them up with \ref attach. All three
+ * descriptors have to be inherited, so it only works with directly spawned
+ * helpers.
+ *
+ * The helper's writes block while the ring is full, the library queues
+ * the rest and sends it when the helper makes space, so its event loop never
+ * waits. A side that is closed or whose process is gone ends the waiting
+ * of the other one.
+ *
+ * The other process can write anything to the shared memory at any time.
+ * The size of the rings is taken once when mapping them and the positions
+ * read from there are checked before every copy, a ring that doesn't add up
+ * is treated like a peer that's gone.
+ */
+class SharedRing : public QIODevice {
+    Q_OBJECT
+public:
+    enum Side {
+        LIBRARY = 0,
+        HELPER
+    };
+
+    /**
+     * Sets up new rings
+     * @param childFds get the descriptors for the helper, to be closed once it's started
+     * @return the library's end, null if the kernel doesn't support memfd or eventfd
+     */
+    static SharedRing *create(QList<int> *childFds, QObject *parent = 0);
+    /**
+     * Helper's end of the rings described by \p address, see \ref address
+     */
+    static SharedRing *attach(const QString &address, QObject *parent = 0);
+    virtual ~SharedRing();
+
+    /**
+     * Descriptors for the command line of the helper
+     */
+    QString address() const;
+
+    void close();
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+    qint64 bytesToWrite() const;
+    bool waitForReadyRead(int msecs);
+    bool waitForBytesWritten(int msecs);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private slots:
+    void bellRung();
+
+private:
+    struct Ring;
+    struct Header;
+
+    SharedRing(Side side, QObject *parent);
+    bool map(int memfd, bool initialize);
+    void watch();
+    qint64 available() const;
+    qint64 put(const char *data, qint64 maxSize);
+    void flushPending();
+    void corrupted() const;
+    bool wait(int msecs);
+    void ring(int fd);
+    void notify();
+    bool peerClosed() const;
+    bool peerGone() const;
+
+    Side m_side { LIBRARY };
+    Header *m_header { nullptr };
+    size_t m_mapped { 0 };
+    char *m_in { nullptr };
+    char *m_out { nullptr };
+    Ring *m_inRing { nullptr };
+    Ring *m_outRing { nullptr };
+    size_t m_size { 0 }; ///< of each ring, never read from the shared memory again
+    quint64 m_read { 0 }; ///< our copy of the tail of \ref m_inRing
+    quint64 m_written { 0 }; ///< our copy of the head of \ref m_outRing
+    mutable bool m_corrupt { false };
+    QByteArray m_pending { }; ///< library only, what didn't fit into the ring yet
+    int m_memfd { -1 };
+    int m_bell { -1 }; ///< ours, we sleep on it
+    int m_peerBell { -1 };
+    QString m_address { };
+    QSocketNotifier *m_notifier { nullptr };
+};
+
+#endif // SHAREDRING_H
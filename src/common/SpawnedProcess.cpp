@@ -0,0 +1,309 @@
+/*
+ * Child process started without forking the caller
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "SpawnedProcess.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+SpawnedProcess::SpawnedProcess(QObject *parent)
+        : QObject(parent) {
+}
+
+SpawnedProcess::~SpawnedProcess() {
+    if (m_pid > 0) {
+        ::kill(m_pid, SIGKILL);
+        waitpid(m_pid, nullptr, 0);
+    }
+    unwatch();
+}
+
+QProcessEnvironment SpawnedProcess::processEnvironment() const {
+    return m_environment;
+}
+
+void SpawnedProcess::setProcessEnvironment(const QProcessEnvironment &environment) {
+    m_environment = environment;
+    m_environmentSet = true;
+}
+
+QProcess::ProcessChannelMode SpawnedProcess::processChannelMode() const {
+    return m_channelMode;
+}
+
+void SpawnedProcess::setProcessChannelMode(QProcess::ProcessChannelMode mode) {
+    m_channelMode = mode;
+}
+
+void SpawnedProcess::setCredentials(const Credentials &credentials) {
+    m_credentials = credentials;
+    m_credentialsSet = true;
+}
+
+void SpawnedProcess::setInheritedFds(const QList<int> &fds) {
+    m_inheritedFds = fds.toVector();
+}
+
+QProcess::ProcessState SpawnedProcess::state() const {
+    return m_pid > 0 ? QProcess::Running : QProcess::NotRunning;
+}
+
+pid_t SpawnedProcess::pid() const {
+    return m_pid;
+}
+
+QString SpawnedProcess::errorString() const {
+    return m_errorString;
+}
+
+void SpawnedProcess::terminate() {
+    if (m_pid > 0)
+        ::kill(m_pid, SIGTERM);
+}
+
+void SpawnedProcess::kill() {
+    if (m_pid > 0)
+        ::kill(m_pid, SIGKILL);
+}
+
+bool SpawnedProcess::start(const QString &program, const QStringList &arguments) {
+    if (m_pid > 0) {
+        qWarning() << " QAuth: SpawnedProcess: Process is already running";
+        return false;
+    }
+
+    // everything the child needs has to be prepared here, it can't allocate
+    QByteArray path = QFile::encodeName(program);
+    QList<QByteArray> args;
+    args << path;
+    for (const QString &arg : arguments)
+        args << arg.toLocal8Bit();
+    QVector<char*> argv;
+    for (QByteArray &arg : args)
+        argv << arg.data();
+    argv << nullptr;
+
+    QList<QByteArray> env;
+    QVector<char*> envp;
+    if (m_environmentSet) {
+        for (const QString &variable : m_environment.toStringList())
+            env << variable.toLocal8Bit();
+        for (QByteArray &variable : env)
+            envp << variable.data();
+        envp << nullptr;
+    }
+
+    int err = 0;
+    char **childEnv = m_environmentSet ? envp.data() : environ;
+    if (m_credentialsSet)
+        m_pid = spawnAs(path, argv.data(), childEnv, &err);
+    else
+        m_pid = spawn(path, argv.data(), childEnv, &err);
+
+    if (m_pid <= 0) {
+        m_pid = 0;
+        m_errorString = QString("Process failed to start: %1").arg(strerror(err));
+        Q_EMIT error(QProcess::FailedToStart);
+        return false;
+    }
+
+    watch();
+    Q_EMIT started();
+    return true;
+}
+
+pid_t SpawnedProcess::spawn(const QByteArray &program, char **argv, char **envp, int *err) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if (m_channelMode != QProcess::ForwardedChannels) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    }
+    // duplicating a descriptor onto itself clears close-on-exec in the child only
+    for (int fd : m_inheritedFds)
+        posix_spawn_file_actions_adddup2(&actions, fd, fd);
+
+    // don't let the child inherit whatever the caller did with signals
+    sigset_t mask, defaults;
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid = 0;
+    *err = posix_spawn(&pid, program.constData(), &actions, &attr, argv, envp);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return *err ? 0 : pid;
+}
+
+/*
+ * posix_spawn can't change the identity of the child, so it has to be forked.
+ * Not vfork, set*id in a child sharing our memory would change the identity
+ * of the caller's other threads in some C libraries. Only async-signal-safe
+ * calls are allowed in the child, the errors come back through a pipe that
+ * gets closed by a successful exec.
+ */
+pid_t SpawnedProcess::spawnAs(const QByteArray &program, char **argv, char **envp, int *err) {
+    const char *path = program.constData();
+    const Credentials &c = m_credentials;
+    const bool forward = m_channelMode == QProcess::ForwardedChannels;
+    const int *inherited = m_inheritedFds.constData();
+    const int inheritedCount = m_inheritedFds.size();
+
+    int status[2];
+    if (pipe2(status, O_CLOEXEC) != 0) {
+        *err = errno;
+        return 0;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int childErr = 0;
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0) {
+            dup2(null, STDIN_FILENO);
+            if (!forward) {
+                dup2(null, STDOUT_FILENO);
+                dup2(null, STDERR_FILENO);
+            }
+            if (null > STDERR_FILENO)
+                close(null);
+        }
+        for (int i = 0; i < inheritedCount; i++)
+            fcntl(inherited[i], F_SETFD, 0);
+        if (setgid(c.gid) != 0
+            || setgroups(c.groups.size(), c.groups.constData()) != 0
+            || setuid(c.uid) != 0) {
+            childErr = errno;
+            while (write(status[1], &childErr, sizeof(childErr)) < 0 && errno == EINTR) { }
+            _exit(2);
+        }
+        if (!c.home.isEmpty() && chdir(c.home.constData()) != 0) {
+            // not fatal, the session will just start somewhere else
+        }
+        execve(path, argv, envp);
+        childErr = errno;
+        while (write(status[1], &childErr, sizeof(childErr)) < 0 && errno == EINTR) { }
+        _exit(127);
+    }
+
+    close(status[1]);
+    if (pid < 0) {
+        *err = errno;
+        close(status[0]);
+        return 0;
+    }
+    // nothing to read means the child got as far as the exec
+    int childErr = 0;
+    ssize_t length;
+    while ((length = read(status[0], &childErr, sizeof(childErr))) < 0 && errno == EINTR) { }
+    close(status[0]);
+    if (length == sizeof(childErr)) {
+        *err = childErr;
+        waitpid(pid, nullptr, 0);
+        return 0;
+    }
+    return pid;
+}
+
+void SpawnedProcess::watch() {
+#ifdef SYS_pidfd_open
+    m_pidfd = syscall(SYS_pidfd_open, m_pid, 0);
+    if (m_pidfd >= 0) {
+        m_notifier = new QSocketNotifier(m_pidfd, QSocketNotifier::Read, this);
+        connect(m_notifier, SIGNAL(activated(int)), this, SLOT(reap()));
+        return;
+    }
+#endif
+    // older kernels don't have pidfds, just keep asking
+    m_timer = new QTimer(this);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(reap()));
+    m_timer->start(50);
+}
+
+/*
+ * Called from the signals of the watchers too, so they can't be deleted right away
+ */
+void SpawnedProcess::unwatch() {
+    if (m_notifier) {
+        m_notifier->setEnabled(false);
+        m_notifier->deleteLater();
+        m_notifier = nullptr;
+    }
+    if (m_timer) {
+        m_timer->stop();
+        m_timer->deleteLater();
+        m_timer = nullptr;
+    }
+    if (m_pidfd >= 0) {
+        close(m_pidfd);
+        m_pidfd = -1;
+    }
+}
+
+void SpawnedProcess::reap() {
+    int status = 0;
+    pid_t result = waitpid(m_pid, &status, WNOHANG);
+    if (result == 0 || (result < 0 && errno == EINTR))
+        return;
+
+    unwatch();
+    m_pid = 0;
+
+    if (result < 0) {
+        m_errorString = QString("Lost track of the process: %1").arg(strerror(errno));
+        Q_EMIT error(QProcess::UnknownError);
+        Q_EMIT finished(-1, QProcess::CrashExit);
+    }
+    else if (WIFSIGNALED(status)) {
+        m_errorString = QString("Process crashed");
+        Q_EMIT error(QProcess::Crashed);
+        Q_EMIT finished(WTERMSIG(status), QProcess::CrashExit);
+    }
+    else {
+        Q_EMIT finished(WEXITSTATUS(status), QProcess::NormalExit);
+    }
+}
+
+#include "SpawnedProcess.moc"
@@ -0,0 +1,128 @@
+/*
+ * Child process started without forking the caller
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef SPAWNEDPROCESS_H
+#define SPAWNEDPROCESS_H
+
+#include <QtCore/QObject>
+#include <QtCore/QProcess>
+#include <QtCore/QProcessEnvironment>
+#include <QtCore/QVector>
+
+#include <sys/types.h>
+
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * Replacement for the parts of QProcess we use
+ *
+ * QProcess forks the caller, which means copying its page tables and taking
+ * copy-on-write faults afterwards. That gets expensive in big processes
+ * like QML greeters. This class uses posix_spawn, so the cost doesn't
+ * depend on the size of the caller. Only when the privileges have to be
+ * dropped before the exec it still forks, see \ref spawnAs.
+ *
+ * Differences from QProcess:
+ *
+ *  * No channels are read, \ref QProcess::SeparateChannels means the output is discarded
+ *
+ *  * Standard input is always /dev/null
+ *
+ *  * \ref start is synchronous, the process is either running or has failed
+ *    when it returns
+ */
+class SpawnedProcess : public QObject {
+    Q_OBJECT
+public:
+    /**
+     * Identity to switch to in the child before it executes the program
+     */
+    struct Credentials {
+        uid_t uid { 0 };
+        gid_t gid { 0 };
+        QVector<gid_t> groups { };
+        QByteArray home { }; ///< working directory of the child
+    };
+
+    explicit SpawnedProcess(QObject *parent = 0);
+    /**
+     * Kills the process if it's still running, the same way QProcess does
+     */
+    virtual ~SpawnedProcess();
+
+    QProcessEnvironment processEnvironment() const;
+    /**
+     * Until this is called, the child inherits the environment of the caller
+     */
+    void setProcessEnvironment(const QProcessEnvironment &environment);
+
+    QProcess::ProcessChannelMode processChannelMode() const;
+    void setProcessChannelMode(QProcess::ProcessChannelMode mode);
+
+    void setCredentials(const Credentials &credentials);
+
+    /**
+     * Descriptors the child keeps across the exec, under the same numbers
+     *
+     * They stay close-on-exec in the caller, so processes spawned
+     * by other threads at the same time don't get them too.
+     */
+    void setInheritedFds(const QList<int> &fds);
+
+    bool start(const QString &program, const QStringList &arguments = QStringList());
+
+    QProcess::ProcessState state() const;
+    pid_t pid() const;
+    QString errorString() const;
+
+public slots:
+    void terminate();
+    void kill();
+
+signals:
+    void started();
+    void finished(int exitCode, QProcess::ExitStatus exitStatus);
+    void error(QProcess::ProcessError error);
+
+private slots:
+    void reap();
+
+private:
+    pid_t spawn(const QByteArray &program, char **argv, char **envp, int *err);
+    pid_t spawnAs(const QByteArray &program, char **argv, char **envp, int *err);
+    void watch();
+    void unwatch();
+
+    QProcessEnvironment m_environment { };
+    bool m_environmentSet { false };
+    QProcess::ProcessChannelMode m_channelMode { QProcess::SeparateChannels };
+    Credentials m_credentials { };
+    bool m_credentialsSet { false };
+    QVector<int> m_inheritedFds { };
+
+    pid_t m_pid { 0 };
+    QString m_errorString { };
+    int m_pidfd { -1 };
+    QSocketNotifier *m_notifier { nullptr };
+    QTimer *m_timer { nullptr };
+};
+
+#endif // SPAWNEDPROCESS_H
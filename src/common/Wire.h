@@ -0,0 +1,120 @@
+/*
+ * Wire format shared by the helper and both libraries
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Everything about the protocol that doesn't need Qt lives here, so the
+ * Qt-free core library speaks it with the same definitions as the rest.
+ * The QDataStream side of it is in Messages.h.
+ */
+
+enum Msg {
+    MSG_UNKNOWN = 0,
+    HELLO = 1,
+    ERROR,
+    INFO,
+    REQUEST,
+    AUTHENTICATED,
+    SESSION_STATUS,
+    BEGIN,
+    FINISHED,
+    FORK,
+    EXITED,
+    CREDENTIALS,
+    ENVIRONMENT,
+    ABORT,
+    MSG_LAST,
+};
+
+/**
+ * Versions of the wire format
+ *
+ * The library offers the newest one it knows on the command line of the
+ * helper and the helper says which one it's going to use in its HELLO.
+ * HELLO itself is always sent using v1, helpers which don't know anything
+ * newer just don't put the version there.
+ */
+enum Protocol {
+    PROTOCOL_V1 = 1, ///< plain QDataStream, native qint64 length header
+    PROTOCOL_V2,     ///< little-endian, quint32 length header, UTF-8 strings, varint lengths
+    PROTOCOL_V3,     ///< v2 encoding, the environment comes in ENVIRONMENT messages, AUTHENTICATED and SESSION_STATUS aren't acknowledged, an empty ENVIRONMENT after AUTHENTICATED ends a session's environment
+    _PROTOCOL_LAST,
+    PROTOCOL_LATEST = _PROTOCOL_LAST - 1
+};
+
+// length header of the v2 frames
+#define WIRE_HEADER_SIZE 4
+// nothing legitimate comes close, anything bigger is a corrupted or hostile stream
+#define WIRE_MAX_FRAME_SIZE (4 * 1024 * 1024)
+// a 64-bit value never takes more
+#define WIRE_MAX_VARINT_SIZE 10
+
+inline void encodeFrameLength(uint32_t length, char *header) {
+    for (int i = 0; i < WIRE_HEADER_SIZE; i++)
+        header[i] = char((length >> (8 * i)) & 0xff);
+}
+
+inline uint32_t decodeFrameLength(const char *header) {
+    uint32_t length = 0;
+    for (int i = 0; i < WIRE_HEADER_SIZE; i++)
+        length |= uint32_t(uint8_t(header[i])) << (8 * i);
+    return length;
+}
+
+/*
+ * Seven bits per byte, the highest one says another byte follows
+ * @return the number of bytes written to \p bytes
+ */
+inline int encodeVarint(uint64_t value, char *bytes) {
+    int length = 0;
+    do {
+        bytes[length] = value & 0x7f;
+        value >>= 7;
+        if (value)
+            bytes[length] |= 0x80;
+        length++;
+    } while (value);
+    return length;
+}
+
+/*
+ * @param next returns the following byte, or -1 when there's none
+ * @return false if the input ended or the value doesn't fit in 64 bits
+ */
+template<typename NextByte>
+inline bool decodeVarint(NextByte next, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = next();
+        if (byte < 0)
+            return false;
+        *value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+#endif // WIRE_H
@@ -0,0 +1,548 @@
+/*
+ * Qt Authentication Library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include "qauthcore.h"
+#include "config.h"
+#include "Wire.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// how long a cancelled helper gets to end its PAM transaction, in ms, like in QAuth
+#define CANCEL_GRACE_PERIOD 500
+#define CANCEL_POLL_INTERVAL 10
+
+extern char **environ;
+
+namespace QAuthCore {
+
+/*
+ * One outgoing frame, the length header is filled in when it's sent
+ */
+class Writer {
+public:
+    void reset() {
+        m_data.assign(WIRE_HEADER_SIZE, '\0');
+    }
+    void varint(uint64_t value) {
+        char bytes[WIRE_MAX_VARINT_SIZE];
+        m_data.append(bytes, encodeVarint(value, bytes));
+    }
+    void bytes(const std::string &bytes) {
+        varint(bytes.length());
+        m_data.append(bytes);
+    }
+    const std::string &frame() {
+        encodeFrameLength(m_data.length() - WIRE_HEADER_SIZE, &m_data[0]);
+        return m_data;
+    }
+    void wipe() {
+        std::fill(m_data.begin(), m_data.end(), '\0');
+    }
+private:
+    std::string m_data { };
+};
+
+/*
+ * Reads the messages of one received frame
+ */
+class Reader {
+public:
+    Reader(const char *data, size_t length)
+            : m_data(data), m_length(length) { }
+
+    bool ok() const {
+        return m_ok;
+    }
+    bool atEnd() const {
+        return !m_ok || m_pos >= m_length;
+    }
+    size_t remaining() const {
+        return atEnd() ? 0 : m_length - m_pos;
+    }
+    uint8_t byte() {
+        if (m_pos >= m_length) {
+            m_ok = false;
+            return 0;
+        }
+        return uint8_t(m_data[m_pos++]);
+    }
+    uint64_t varint() {
+        uint64_t value = 0;
+        if (!m_ok || !decodeVarint([this]() -> int {
+                return m_pos < m_length ? uint8_t(m_data[m_pos++]) : -1;
+            }, &value)) {
+            m_ok = false;
+            return 0;
+        }
+        return value;
+    }
+    std::string bytes() {
+        uint64_t length = varint();
+        if (!m_ok || length > m_length - m_pos) {
+            m_ok = false;
+            return std::string();
+        }
+        std::string result(m_data + m_pos, length);
+        m_pos += length;
+        return result;
+    }
+    int32_t int32() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+            value |= uint32_t(byte()) << (8 * i);
+        return int32_t(value);
+    }
+private:
+    const char *m_data { nullptr };
+    size_t m_length { 0 };
+    size_t m_pos { 0 };
+    bool m_ok { true };
+};
+
+class Authenticator::Private {
+public:
+    void fail(Error error, const std::string &message);
+    void handleFrames();
+    void handleMessage(Reader &r);
+    bool send();
+    void finish(bool reap);
+
+    std::string helperPath { QAUTH_HELPER_PATH };
+    std::string user { };
+    std::string secret { }; ///< wiped once it's sent
+    bool verbose { false };
+    int maxAttempts { 1 };
+    RequestHandler requestHandler { };
+    InfoHandler infoHandler { };
+    ErrorHandler errorHandler { };
+    FinishedHandler finishedHandler { };
+
+    pid_t pid { 0 };
+    int fd { -1 };
+    std::string input { };
+    Writer output { };
+    Result result { };
+    bool authenticated { false };
+};
+
+void Authenticator::Private::fail(Error error, const std::string &message) {
+    result.error = error;
+    result.message = message;
+    if (errorHandler)
+        errorHandler(message, error);
+}
+
+/*
+ * Whole frames only, a partial one waits for the rest
+ */
+void Authenticator::Private::handleFrames() {
+    size_t pos = 0;
+    while (input.length() - pos >= WIRE_HEADER_SIZE) {
+        uint32_t length = decodeFrameLength(input.data() + pos);
+        if (length > WIRE_MAX_FRAME_SIZE) {
+            // there's no telling where the next frame starts, the helper is of no use anymore
+            fail(ERROR_INTERNAL, "QAuth: Received a broken message");
+            input.clear();
+            finish(true);
+            return;
+        }
+        if (input.length() - pos - WIRE_HEADER_SIZE < length)
+            break;
+
+        // batched frames carry several messages
+        Reader r(input.data() + pos + WIRE_HEADER_SIZE, length);
+        while (!r.atEnd() && fd >= 0)
+            handleMessage(r);
+        if (!r.ok())
+            fail(ERROR_INTERNAL, "QAuth: Received a broken message");
+        pos += WIRE_HEADER_SIZE + length;
+        if (fd < 0)
+            break;
+    }
+    input.erase(0, pos);
+}
+
+void Authenticator::Private::handleMessage(Reader &r) {
+    Msg m = Msg(r.varint());
+    switch (m) {
+        case ERROR: {
+            std::string message = r.bytes();
+            Error type = Error(r.varint());
+            if (r.ok())
+                fail(type, message);
+            break;
+        }
+        case INFO: {
+            std::string message = r.bytes();
+            Info type = Info(r.varint());
+            if (r.ok() && infoHandler)
+                infoHandler(message, type);
+            break;
+        }
+        case REQUEST: {
+            // every prompt takes at least four bytes, a bigger count is a lie
+            uint64_t length = r.varint();
+            if (length > r.remaining() / 4) {
+                fail(ERROR_INTERNAL, "QAuth: Received a broken message");
+                r = Reader(nullptr, 0);
+                break;
+            }
+            std::vector<Prompt> prompts(length);
+            for (size_t i = 0; i < prompts.size() && r.ok(); i++) {
+                prompts[i].type = PromptType(r.varint());
+                prompts[i].message = r.bytes();
+                prompts[i].hidden = r.byte();
+                prompts[i].response = r.bytes();
+            }
+            if (!r.ok())
+                break;
+            if (requestHandler)
+                requestHandler(prompts);
+
+            // only the responses go back, keyed by the index of their prompt
+            size_t count = 0;
+            for (const Prompt &p : prompts) {
+                if (!p.response.empty())
+                    count++;
+            }
+            output.reset();
+            output.varint(REQUEST);
+            output.varint(count);
+            for (size_t i = 0; i < prompts.size(); i++) {
+                if (prompts[i].response.empty())
+                    continue;
+                output.varint(i);
+                output.bytes(prompts[i].response);
+                std::fill(prompts[i].response.begin(), prompts[i].response.end(), '\0');
+            }
+            send();
+            output.wipe();
+            break;
+        }
+        case AUTHENTICATED: {
+            std::string name = r.bytes();
+            if (!r.ok() || name.empty())
+                break;
+            result.user = name;
+            authenticated = true;
+            break;
+        }
+        case SESSION_STATUS: {
+            r.byte();
+            break;
+        }
+        case FINISHED: {
+            r.int32();
+            break;
+        }
+        default: {
+            fail(ERROR_INTERNAL, "QAuth: Unexpected message received");
+            // the rest of the frame can't be made sense of
+            r = Reader(nullptr, 0);
+        }
+    }
+}
+
+bool Authenticator::Private::send() {
+    const std::string &frame = output.frame();
+    size_t written = 0;
+    while (written < frame.length()) {
+        ssize_t ret = ::send(fd, frame.data() + written, frame.length() - written, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { fd, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return false;
+        }
+        written += ret;
+    }
+    return true;
+}
+
+/*
+ * The exit code of the helper has the final word, like in QAuth
+ */
+void Authenticator::Private::finish(bool reap) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (pid > 0 && reap) {
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+        if (!WIFEXITED(status))
+            fail(ERROR_INTERNAL, "QAuth: The helper crashed");
+        result.success = WIFEXITED(status) && WEXITSTATUS(status) == 0 && authenticated;
+    }
+    pid = 0;
+    if (!result.success)
+        result.user.clear();
+    if (finishedHandler)
+        finishedHandler(result);
+}
+
+
+Authenticator::Authenticator()
+        : d(new Private()) { }
+
+Authenticator::~Authenticator() {
+    if (d->pid > 0) {
+        kill(d->pid, SIGKILL);
+        while (waitpid(d->pid, nullptr, 0) < 0 && errno == EINTR) { }
+    }
+    if (d->fd >= 0)
+        close(d->fd);
+    std::fill(d->secret.begin(), d->secret.end(), '\0');
+    delete d;
+}
+
+void Authenticator::setUser(const std::string &user) {
+    d->user = user;
+}
+
+void Authenticator::setSecret(const std::string &secret) {
+    std::fill(d->secret.begin(), d->secret.end(), '\0');
+    d->secret = secret;
+}
+
+void Authenticator::setHelperPath(const std::string &path) {
+    d->helperPath = path;
+}
+
+void Authenticator::setVerbose(bool on) {
+    d->verbose = on;
+}
+
+void Authenticator::setMaxAttempts(int attempts) {
+    d->maxAttempts = std::max(1, attempts);
+}
+
+void Authenticator::onRequest(const RequestHandler &handler) {
+    d->requestHandler = handler;
+}
+
+void Authenticator::onInfo(const InfoHandler &handler) {
+    d->infoHandler = handler;
+}
+
+void Authenticator::onError(const ErrorHandler &handler) {
+    d->errorHandler = handler;
+}
+
+void Authenticator::onFinished(const FinishedHandler &handler) {
+    d->finishedHandler = handler;
+}
+
+bool Authenticator::start() {
+    if (d->pid > 0)
+        return false;
+    d->result = Result();
+    d->authenticated = false;
+    d->input.clear();
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        d->fail(ERROR_INTERNAL, std::string("QAuth: socketpair: ") + strerror(errno));
+        return false;
+    }
+
+    std::vector<std::string> args = {
+        d->helperPath,
+        "--fd", std::to_string(fds[1]),
+        "--protocol", std::to_string(PROTOCOL_V3),
+        "--batch"
+    };
+    if (!d->user.empty()) {
+        args.push_back("--user");
+        args.push_back(d->user);
+    }
+    if (!d->secret.empty())
+        args.push_back("--credentials");
+    if (d->maxAttempts > 1) {
+        args.push_back("--attempts");
+        args.push_back(std::to_string(d->maxAttempts));
+    }
+    std::vector<char*> argv;
+    for (std::string &arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if (!d->verbose) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    // only the helper's end survives the exec, and only in the helper,
+    // duplicating it onto itself clears close-on-exec in the child
+    posix_spawn_file_actions_adddup2(&actions, fds[1], fds[1]);
+    int err = posix_spawn(&d->pid, d->helperPath.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (err != 0) {
+        d->pid = 0;
+        close(fds[0]);
+        d->fail(ERROR_INTERNAL, std::string("QAuth: Could not start the helper: ") + strerror(err));
+        return false;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    d->fd = fds[0];
+
+    // the helper waits for it before doing anything
+    if (!d->secret.empty()) {
+        d->output.reset();
+        d->output.varint(CREDENTIALS);
+        d->output.bytes(d->secret);
+        d->send();
+        d->output.wipe();
+        std::fill(d->secret.begin(), d->secret.end(), '\0');
+        d->secret.clear();
+    }
+    return true;
+}
+
+int Authenticator::fd() const {
+    return d->fd;
+}
+
+bool Authenticator::process() {
+    if (d->fd < 0)
+        return false;
+
+    char buffer[4096];
+    ssize_t length;
+    do {
+        length = read(d->fd, buffer, sizeof(buffer));
+        if (length > 0)
+            d->input.append(buffer, length);
+    } while (length > 0 || (length < 0 && errno == EINTR));
+    bool closed = length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+
+    d->handleFrames();
+    // end of the connection, the helper is done
+    if (d->fd >= 0 && closed)
+        d->finish(true);
+    return d->fd >= 0;
+}
+
+Result Authenticator::run(int timeout) {
+    if (d->fd < 0 && !start())
+        return d->result;
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    while (d->fd >= 0) {
+        int left = -1;
+        if (timeout >= 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long elapsed = (now.tv_sec - started.tv_sec) * 1000 + (now.tv_nsec - started.tv_nsec) / 1000000;
+            left = timeout - elapsed;
+            if (left <= 0) {
+                d->fail(ERROR_TIMEOUT, "QAuth: The authentication took too long");
+                cancel();
+                break;
+            }
+        }
+        struct pollfd pfd = { d->fd, POLLIN, 0 };
+        int ret = poll(&pfd, 1, left);
+        if (ret < 0 && errno != EINTR) {
+            d->fail(ERROR_INTERNAL, std::string("QAuth: poll: ") + strerror(errno));
+            cancel();
+            break;
+        }
+        if (ret > 0)
+            process();
+    }
+    return d->result;
+}
+
+void Authenticator::cancel() {
+    if (d->pid <= 0)
+        return;
+    if (d->result.error != ERROR_TIMEOUT)
+        d->fail(ERROR_CANCELLED, "QAuth: The authentication was cancelled");
+    kill(d->pid, SIGTERM);
+    // a helper stuck in a module mustn't hold up the caller, it gets killed then
+    bool reaped = false;
+    for (int waited = 0; !reaped && waited < CANCEL_GRACE_PERIOD; waited += CANCEL_POLL_INTERVAL) {
+        pid_t ret = waitpid(d->pid, nullptr, WNOHANG);
+        reaped = ret == d->pid || (ret < 0 && errno != EINTR);
+        if (!reaped) {
+            struct timespec interval = { 0, CANCEL_POLL_INTERVAL * 1000000L };
+            nanosleep(&interval, nullptr);
+        }
+    }
+    if (!reaped) {
+        kill(d->pid, SIGKILL);
+        while (waitpid(d->pid, nullptr, 0) < 0 && errno == EINTR) { }
+    }
+    d->authenticated = false;
+    d->finish(false);
+}
+
+bool Authenticator::running() const {
+    return d->pid > 0;
+}
+
+const Result &Authenticator::result() const {
+    return d->result;
+}
+
+
+Result authenticate(const std::string &user, const std::string &secret, int timeout) {
+    Authenticator authenticator;
+    authenticator.setUser(user);
+    authenticator.setSecret(secret);
+    authenticator.onRequest([&](std::vector<Prompt> &prompts) {
+        for (Prompt &prompt : prompts) {
+            switch (prompt.type) {
+                case LOGIN_USER:
+                    prompt.response = user;
+                    break;
+                case LOGIN_PASSWORD:
+                    prompt.response = secret;
+                    break;
+                default:
+                    break;
+            }
+        }
+    });
+    return authenticator.run(timeout);
+}
+
+}
@@ -0,0 +1,183 @@
+/*
+ * Qt Authentication library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef QAUTHCORE_H
+#define QAUTHCORE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/**
+ * Plain C++ client of the authentication helper
+ *
+ * For programs which only need to check credentials and don't want to load
+ * Qt for it. It talks to the same helper as \ref QAuth, using the compact
+ * wire protocol over a socketpair, and is driven either by the caller's
+ * own poll/epoll loop (\ref Authenticator::fd and \ref Authenticator::process)
+ * or by \ref Authenticator::run. Only checks are supported, sessions and the
+ * helper pool, fork server and multiplexing stay with \ref QAuth.
+ *
+ * The values of the enums are the same as those of \ref QAuth and \ref QAuthPrompt.
+ */
+namespace QAuthCore {
+
+enum PromptType {
+    NONE = 0x0000,
+    UNKNOWN = 0x0001,
+    CHANGE_CURRENT = 0x0010,
+    CHANGE_NEW,
+    CHANGE_REPEAT,
+    LOGIN_USER = 0x0080,
+    LOGIN_PASSWORD
+};
+
+enum Info {
+    INFO_NONE = 0,
+    INFO_UNKNOWN,
+    INFO_PASS_CHANGE_REQUIRED
+};
+
+enum Error {
+    ERROR_NONE = 0,
+    ERROR_UNKNOWN,
+    ERROR_AUTHENTICATION,
+    ERROR_INTERNAL,
+    ERROR_CANCELLED,
+    ERROR_TIMEOUT
+};
+
+struct Prompt {
+    PromptType type { NONE };
+    std::string message { };  ///< from the stack, prefer \ref type
+    bool hidden { false };    ///< the response shouldn't be shown
+    std::string response { }; ///< to be filled by the request handler
+};
+
+struct Result {
+    bool success { false };
+    std::string user { };       ///< the authenticated user, empty on failure
+    Error error { ERROR_NONE }; ///< the last error reported
+    std::string message { };    ///< message of the last error
+};
+
+/**
+ * One check, one helper process
+ *
+ * The handlers are called from \ref process (or \ref run), in the calling thread.
+ */
+class Authenticator {
+public:
+    typedef std::function<void(std::vector<Prompt> &prompts)> RequestHandler;
+    typedef std::function<void(const std::string &message, Info type)> InfoHandler;
+    typedef std::function<void(const std::string &message, Error type)> ErrorHandler;
+    typedef std::function<void(const Result &result)> FinishedHandler;
+
+    Authenticator();
+    /**
+     * Kills the helper if it's still running
+     */
+    ~Authenticator();
+
+    Authenticator(const Authenticator &) = delete;
+    Authenticator &operator=(const Authenticator &) = delete;
+
+    /**
+     * @param user username, the helper asks for it if it's empty
+     */
+    void setUser(const std::string &user);
+    /**
+     * @param secret the password, sent to the helper right after it starts
+     *      to answer the login prompts there, wiped once it's sent
+     */
+    void setSecret(const std::string &secret);
+    /**
+     * @param path of the helper, the installed one by default
+     */
+    void setHelperPath(const std::string &path);
+    /**
+     * @param on let the helper write to our stdout and stderr
+     */
+    void setVerbose(bool on);
+    /**
+     * @param attempts how many times the prompts can be answered before
+     *      the check fails, the request handler is called again after each failure
+     */
+    void setMaxAttempts(int attempts);
+
+    /**
+     * Fill the responses of the prompts, they're sent as soon as the handler returns
+     */
+    void onRequest(const RequestHandler &handler);
+    void onInfo(const InfoHandler &handler);
+    void onError(const ErrorHandler &handler);
+    void onFinished(const FinishedHandler &handler);
+
+    /**
+     * Launches the helper
+     * @return false if it couldn't be started, the error is in \ref result
+     */
+    bool start();
+
+    /**
+     * @return the connection to the helper to wait for (readable), -1 when not running
+     */
+    int fd() const;
+
+    /**
+     * Handles everything the helper sent, without blocking
+     * @return false once the check is finished
+     */
+    bool process();
+
+    /**
+     * Runs the check to its end, waiting in poll
+     * @param timeout in ms, -1 for none, the check is cancelled with \ref ERROR_TIMEOUT when it passes
+     */
+    Result run(int timeout = -1);
+
+    /**
+     * Terminates the helper, the check finishes with \ref ERROR_CANCELLED.
+     * Blocks for half a second at most, a helper which doesn't quit by then is killed.
+     */
+    void cancel();
+
+    bool running() const;
+    const Result &result() const;
+
+private:
+    class Private;
+    Private *d { nullptr };
+};
+
+/**
+ * Checks \p secret of \p user and waits for the result
+ *
+ * User name prompts get \p user, password prompts \p secret, anything
+ * else stays empty and fails the check.
+ * @param timeout in ms, -1 for none
+ */
+Result authenticate(const std::string &user, const std::string &secret, int timeout = -1);
+
+}
+
+#endif // QAUTHCORE_H
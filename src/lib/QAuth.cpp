@@ -19,11 +19,20 @@
  */
 
 #include "qauth.h"
+#include "ChannelDevice.h"
 #include "Messages.h"
 #include "SafeDataStream.h"
+#include "SharedRing.h"
+#include "SpawnedProcess.h"
 #include "config.h"
 
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureInterface>
+#include <QtCore/QHash>
 #include <QtCore/QProcess>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QTimer>
 #include <QtNetwork/QLocalServer>
 #include <QtNetwork/QLocalSocket>
 
@@ -33,47 +42,240 @@
 # include <QtDeclarative/QtDeclarative>
 #endif
 
+#include <atomic>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+
+// how long an aborted helper gets to quit on its own
+#define ABORT_GRACE_PERIOD 500
 
 class QAuth::SocketServer : public QLocalServer {
     Q_OBJECT
 public slots:
     void handleNewConnection();
+    void helloPending();
+    void pendingDisconnected();
 public:
     static SocketServer *instance();
 
-    QMap<qint64, QAuth::Private*> helpers;
+    QString address();
+    QStringList connectionArgs(qint64 id, QObject *parent, QIODevice **socket, QList<int> *childFds);
+
+    QHash<qint64, QAuth::Private*> helpers; ///< instances by their ID, each removes itself when it's gone
+    Transport transport { TRANSPORT_LOCAL_SERVER };
 private:
-    static QAuth::SocketServer *self;
+    void greet(QLocalSocket *socket);
+    QHash<QLocalSocket*, SafeDataStream*> m_pending { }; ///< connections which didn't say HELLO yet
+    static QThreadStorage<QAuth::SocketServer*> self; ///< one for every thread using the library
     SocketServer();
 };
 
-QAuth::SocketServer *QAuth::SocketServer::self = nullptr;
+QThreadStorage<QAuth::SocketServer*> QAuth::SocketServer::self;
 
 class QAuth::Private : public QObject {
     Q_OBJECT
 public:
     Private(QAuth *parent);
-    void setSocket(QLocalSocket *socket);
+    ~Private();
+    void setChild(SpawnedProcess *process);
+    void setSocket(QIODevice *socket, int protocol);
+    void adopt(SpawnedProcess *process, QIODevice *socket, qint64 id, int protocol);
+    void release();
+    void openChannel();
+    void closeChannel();
+    void closeConnection();
+    void begin();
+    void sendCredentials();
+    void sendEnvironment(const QProcessEnvironment &env);
+    void handleMessage();
+    bool respond(Request &r);
+    void launch();
+    void finish(bool success);
+    void abort(Error error, const QString &message);
 public slots:
     void dataPending();
+    void deadlinePassed();
+    void channelClosed();
     void childExited(int exitCode, QProcess::ExitStatus exitStatus);
     void childError(QProcess::ProcessError error);
     void requestFinished();
 public:
     QAuthRequest *request { nullptr };
-    QProcess *child { nullptr };
-    QLocalSocket *socket { nullptr };
+    QAuthResponder *responder { nullptr };
+    SpawnedProcess *child { nullptr };
+    QIODevice *socket { nullptr }; ///< a QLocalSocket, a SharedRing or a channel of the multiplexer
+    SafeDataStream *stream { nullptr }; ///< lives as long as \ref socket is ours
     QString sessionPath { };
     QString user { };
+    QByteArray secret { }; ///< wiped once it's sent
     bool autologin { false };
+    bool verbose { false }; ///< applied to every \ref child, a fresh one replaces it after each check
     QProcessEnvironment environment { };
     qint64 id { 0 };
-    static qint64 lastId;
+    bool forked { false }; ///< the helper comes from the fork server, \ref child is not used
+    bool multiplexed { false }; ///< served by the multiplexer, \ref child is not used
+    bool active { false }; ///< between \ref start and \ref finished
+    bool admitted { false }; ///< counted by the \ref Scheduler as running
+    int priority { 0 };
+    int maxAttempts { 1 };
+    QElapsedTimer queued { }; ///< since entering the queue of the \ref Scheduler
+    QTimer *deadline { nullptr };
+    static std::atomic<qint64> lastId; ///< shared by all threads, IDs are unique in the process
+};
+
+std::atomic<qint64> QAuth::Private::lastId { 1 };
+
+class QAuth::HelperPool : public QObject {
+    Q_OBJECT
+public slots:
+    void refill();
+    void helperExited();
+public:
+    static HelperPool *instance();
+
+    void forkedExited(qint64 id);
+
+    bool contains(qint64 id) const;
+    void setSocket(qint64 id, QLocalSocket *socket, int protocol);
+    bool take(SpawnedProcess **process, QIODevice **socket, qint64 *id, int *protocol);
+    void giveBack(SpawnedProcess *process, QIODevice *socket, qint64 id, int protocol);
+    QStringList keepAliveArgs() const;
+
+    int size { 0 };
+    quint64 hits { 0 };
+    quint64 misses { 0 };
+    int keepAliveTimeout { 0 };
+    int keepAliveChecks { 0 };
+private:
+    struct Helper {
+        SpawnedProcess *process { nullptr };
+        QIODevice *socket { nullptr }; ///< null until the helper says HELLO
+        int protocol { PROTOCOL_V1 };
+        QElapsedTimer idle { }; ///< valid only for helpers returned after a check
+    };
+    void remove(QMap<qint64, Helper>::iterator it);
+    QMap<qint64, Helper> m_helpers { };
+    static QThreadStorage<QAuth::HelperPool*> self;
+    HelperPool();
+};
+
+QThreadStorage<QAuth::HelperPool*> QAuth::HelperPool::self;
+
+class QAuth::ForkServer : public QObject {
+    Q_OBJECT
+public slots:
+    void dataPending();
+    void stop();
+    void abortTimedOut();
+public:
+    static ForkServer *instance();
+
+    void start();
+    bool running() const;
+    void setSocket(QLocalSocket *socket);
+    bool fork(qint64 id);
+    void abort(qint64 id);
+
+    qint64 id { 0 };
+private:
+    SpawnedProcess *m_process { nullptr };
+    QLocalSocket *m_socket { nullptr };
+    SafeDataStream *m_stream { nullptr };
+    QHash<qint64, QTimer*> m_aborted { }; ///< children given a moment to quit on their own
+    static QThreadStorage<QAuth::ForkServer*> self;
+    ForkServer();
 };
 
-qint64 QAuth::Private::lastId = 1;
+QThreadStorage<QAuth::ForkServer*> QAuth::ForkServer::self;
+
+class QAuth::Multiplexer : public QObject {
+    Q_OBJECT
+public slots:
+    void dataPending();
+    void stop();
+    void send(qint64 channel, const QByteArray &chunk);
+    void abortTimedOut();
+public:
+    static Multiplexer *instance();
+
+    void start();
+    bool running() const;
+    bool available() const;
+    void setSocket(QLocalSocket *socket, int protocol);
+    ChannelDevice *open(qint64 channel, QObject *parent);
+    void close(qint64 channel);
+    void abort(qint64 channel);
+
+    qint64 id { 0 };
+    int protocol { PROTOCOL_V1 };
+private:
+    SpawnedProcess *m_process { nullptr };
+    QLocalSocket *m_socket { nullptr };
+    SafeDataStream *m_stream { nullptr };
+    QHash<qint64, ChannelDevice*> m_channels { };
+    QHash<qint64, QTimer*> m_aborted { }; ///< closed channels whose checks haven't ended yet
+    bool m_stuck { false }; ///< a check didn't stop, the helper goes once the others are over
+    void retireIfIdle();
+    static QThreadStorage<QAuth::Multiplexer*> self;
+    Multiplexer();
+};
+
+QThreadStorage<QAuth::Multiplexer*> QAuth::Multiplexer::self;
+
+class QAuth::Scheduler : public QObject {
+    Q_OBJECT
+public slots:
+    void dispatch();
+public:
+    static Scheduler *instance();
+
+    bool admit(Private *d);
+    void release(Private *d);
+
+    int maximum { 0 }; ///< of running instances, 0 for no limit
+    int running { 0 };
+    QList<Private*> queue { }; ///< by priority, FIFO within the same one
+    quint64 waited { 0 }; ///< instances which went through the queue
+    qint64 totalWait { 0 };
+    qint64 maxWait { 0 };
+private:
+    static QThreadStorage<QAuth::Scheduler*> self;
+    Scheduler();
+};
+
+QThreadStorage<QAuth::Scheduler*> QAuth::Scheduler::self;
+
+class QAuth::Authenticator : public QObject, public QAuthResponder {
+    Q_OBJECT
+public slots:
+    void error(QString message, QAuth::Error type);
+    void authentication(QString user, bool success);
+    void finished(bool success);
+public:
+    Authenticator(const QString &user, const QByteArray &secret);
+    virtual ~Authenticator();
+
+    QFuture<AuthResult> start();
+    bool respond(QList<QAuthResponder::Prompt> &prompts);
+private:
+    QFutureInterface<AuthResult> m_future { };
+    QAuth *m_auth { nullptr };
+    QByteArray m_user { };
+    QByteArray m_secret { };
+    AuthResult m_result { };
+};
 
+static SpawnedProcess *helperProcess(QObject *parent) {
+    SpawnedProcess *process = new SpawnedProcess(parent);
+    QProcessEnvironment env = process->processEnvironment();
+    env.insert("LANG", "C");
+    process->setProcessEnvironment(env);
+    return process;
+}
 
 
 QAuth::SocketServer::SocketServer()
@@ -83,86 +285,956 @@ QAuth::SocketServer::SocketServer()
 
 void QAuth::SocketServer::handleNewConnection()  {
     while (hasPendingConnections()) {
-        Msg m = Msg::MSG_UNKNOWN;
-        qint64 id;
         QLocalSocket *socket = nextPendingConnection();
-        SafeDataStream str(socket);
-        str.receive();
-        str >> m >> id;
-        if (m == Msg::HELLO && id && SocketServer::instance()->helpers.contains(id)) {
-            helpers[id]->setSocket(socket);
-            if (socket->bytesAvailable() > 0)
-                helpers[id]->dataPending();
+        // the HELLO doesn't have to be there yet, never wait for it in the event loop
+        m_pending[socket] = new SafeDataStream(socket);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(helloPending()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(pendingDisconnected()));
+        if (socket->bytesAvailable() > 0)
+            greet(socket);
+    }
+}
+
+void QAuth::SocketServer::helloPending() {
+    greet(qobject_cast<QLocalSocket*>(sender()));
+}
+
+void QAuth::SocketServer::pendingDisconnected() {
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    delete m_pending.take(socket);
+    socket->deleteLater();
+}
+
+void QAuth::SocketServer::greet(QLocalSocket *socket) {
+    SafeDataStream *str = m_pending.value(socket, nullptr);
+    if (!str || !str->tryReceive())
+        return;
+
+    Msg m = Msg::MSG_UNKNOWN;
+    qint64 id = 0;
+    qint32 protocol = PROTOCOL_V1;
+    *str >> m >> id;
+    // helpers knowing only v1 don't say anything about the protocol
+    if (!str->atEnd())
+        *str >> protocol;
+    m_pending.remove(socket);
+    delete str;
+    disconnect(socket, 0, this, 0);
+
+    if (protocol < PROTOCOL_V1 || protocol > PROTOCOL_LATEST) {
+        qWarning() << " QAuth: Helper" << id << "wants an unknown protocol version" << protocol;
+        socket->deleteLater();
+    }
+    else if (m == Msg::HELLO && id && helpers.contains(id)) {
+        helpers[id]->setSocket(socket, protocol);
+        // forked helpers start in the pooled mode and need to be told what to do
+        if (helpers[id]->forked)
+            helpers[id]->begin();
+        else {
+            helpers[id]->sendCredentials();
+            helpers[id]->sendEnvironment(helpers[id]->environment);
         }
+        if (socket->bytesAvailable() > 0)
+            helpers[id]->dataPending();
+    }
+    else if (m == Msg::HELLO && id && HelperPool::instance()->contains(id)) {
+        HelperPool::instance()->setSocket(id, socket, protocol);
+    }
+    else if (m == Msg::HELLO && id && id == ForkServer::instance()->id) {
+        ForkServer::instance()->setSocket(socket);
+    }
+    else if (m == Msg::HELLO && id && id == Multiplexer::instance()->id) {
+        Multiplexer::instance()->setSocket(socket, protocol);
+    }
+    else {
+        qWarning() << " QAuth: Unknown connection, expected HELLO and got:" << m << id;
+        socket->deleteLater();
     }
 }
 
 QAuth::SocketServer* QAuth::SocketServer::instance() {
-    if (!self) {
-        self = new SocketServer();
+    if (!self.hasLocalData())
+        self.setLocalData(new SocketServer());
+    return self.localData();
+}
+
+/*
+ * Starts listening only when someone actually needs to connect,
+ * helpers on a socketpair never do
+ */
+QString QAuth::SocketServer::address() {
+    if (!isListening()) {
         // TODO until i'm not too lazy to actually hash something
-        self->listen(QString("QAuth%1.%2").arg(getpid()).arg(time(NULL)));
+        static std::atomic<int> servers { 0 };
+        listen(QString("QAuth%1.%2.%3").arg(getpid()).arg(time(NULL)).arg(servers++));
+    }
+    return fullServerName();
+}
+
+/*
+ * Arguments telling a new helper how to reach us.
+ *
+ * With socketpairs and shared memory, \p socket gets our end of the connection
+ * and \p childFds have to be inherited by the helper and closed once it's
+ * started. They're close-on-exec until the helper process says otherwise. Otherwise
+ * they're left untouched and the helper identifies itself using HELLO.
+ */
+QStringList QAuth::SocketServer::connectionArgs(qint64 id, QObject *parent, QIODevice **socket, QList<int> *childFds) {
+    QStringList args;
+    if (transport == TRANSPORT_SHARED_MEMORY) {
+        SharedRing *ring = SharedRing::create(childFds, parent);
+        if (ring) {
+            *socket = ring;
+            args << "--ring" << ring->address();
+            args << "--protocol" << QString("%1").arg(PROTOCOL_LATEST);
+            args << "--batch";
+            return args;
+        }
+        qWarning() << " QAuth: Shared memory not available, falling back to the local server";
+    }
+    if (transport == TRANSPORT_SOCKETPAIR) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0) {
+            QLocalSocket *local = new QLocalSocket(parent);
+            local->setSocketDescriptor(fds[0], QLocalSocket::ConnectedState, QIODevice::ReadWrite);
+            *socket = local;
+            *childFds << fds[1];
+            args << "--fd" << QString("%1").arg(fds[1]);
+            args << "--protocol" << QString("%1").arg(PROTOCOL_LATEST);
+            args << "--batch";
+            return args;
+        }
+        qWarning() << " QAuth: socketpair:" << strerror(errno) << "- falling back to the local server";
+    }
+    args << "--socket" << address();
+    args << "--id" << QString("%1").arg(id);
+    args << "--protocol" << QString("%1").arg(PROTOCOL_LATEST);
+    args << "--batch";
+    return args;
+}
+
+
+QAuth::HelperPool::HelperPool()
+        : QObject() {
+}
+
+QAuth::HelperPool* QAuth::HelperPool::instance() {
+    if (!self.hasLocalData())
+        self.setLocalData(new HelperPool());
+    return self.localData();
+}
+
+bool QAuth::HelperPool::contains(qint64 id) const {
+    return m_helpers.contains(id);
+}
+
+void QAuth::HelperPool::setSocket(qint64 id, QLocalSocket *socket, int protocol) {
+    m_helpers[id].socket = socket;
+    m_helpers[id].protocol = protocol;
+}
+
+QStringList QAuth::HelperPool::keepAliveArgs() const {
+    QStringList args;
+    if (size > 0 && keepAliveTimeout > 0) {
+        args << "--keep-alive" << QString("%1").arg(keepAliveTimeout);
+        if (keepAliveChecks > 0)
+            args << "--max-checks" << QString("%1").arg(keepAliveChecks);
+    }
+    return args;
+}
+
+void QAuth::HelperPool::remove(QMap<qint64, Helper>::iterator it) {
+    // forked helpers have no process to kill, they quit when the socket closes
+    delete it->socket;
+    if (it->process) {
+        disconnect(it->process, 0, this, 0);
+        // the destructor takes care of killing the helper
+        it->process->deleteLater();
+    }
+    m_helpers.erase(it);
+}
+
+void QAuth::HelperPool::refill() {
+    while (m_helpers.size() > size)
+        remove(m_helpers.begin());
+
+    while (m_helpers.size() < size) {
+        qint64 id = Private::lastId++;
+        if (ForkServer::instance()->fork(id)) {
+            m_helpers[id].process = nullptr;
+            continue;
+        }
+
+        SpawnedProcess *process = helperProcess(this);
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(helperExited()));
+        connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(helperExited()));
+
+        QIODevice *socket = nullptr;
+        QList<int> childFds;
+        QStringList args = SocketServer::instance()->connectionArgs(id, this, &socket, &childFds);
+        args << "--pool";
+        args << keepAliveArgs();
+        m_helpers[id].process = process;
+        // helpers on a socketpair are ready as soon as they run, no HELLO is coming
+        m_helpers[id].socket = socket;
+        m_helpers[id].protocol = PROTOCOL_LATEST;
+        process->setInheritedFds(childFds);
+        bool started = process->start(QAUTH_HELPER_PATH, args);
+        for (int fd : childFds)
+            close(fd);
+        // the entry is gone already, no point in trying again right now
+        if (!started)
+            break;
+    }
+}
+
+void QAuth::HelperPool::helperExited() {
+    SpawnedProcess *process = qobject_cast<SpawnedProcess*>(sender());
+    for (auto it = m_helpers.begin(); it != m_helpers.end(); ++it) {
+        if (it->process == process) {
+            if (it->socket)
+                it->socket->deleteLater();
+            m_helpers.erase(it);
+            break;
+        }
+    }
+    // don't refill here, a helper that can't start would just keep respawning
+    process->deleteLater();
+}
+
+void QAuth::HelperPool::forkedExited(qint64 id) {
+    auto it = m_helpers.find(id);
+    if (it == m_helpers.end())
+        return;
+    if (it->socket)
+        it->socket->deleteLater();
+    m_helpers.erase(it);
+}
+
+/*
+ * Only helpers which already said HELLO are handed out, the rest is still starting up
+ */
+bool QAuth::HelperPool::take(SpawnedProcess **process, QIODevice **socket, qint64 *id, int *protocol) {
+    if (size <= 0)
+        return false;
+
+    QTimer::singleShot(0, this, SLOT(refill()));
+
+    for (auto it = m_helpers.begin(); it != m_helpers.end(); ) {
+        // don't risk handing out a helper which is just about to time out on its own
+        if (it->idle.isValid() && it->idle.elapsed() > keepAliveTimeout / 2) {
+            auto stale = it++;
+            remove(stale);
+            continue;
+        }
+        if (it->socket && (!it->process || it->process->state() == QProcess::Running)) {
+            if (it->process)
+                disconnect(it->process, 0, this, 0);
+            *process = it->process;
+            *socket = it->socket;
+            *id = it.key();
+            *protocol = it->protocol;
+            m_helpers.erase(it);
+            hits++;
+            return true;
+        }
+        ++it;
+    }
+
+    misses++;
+    return false;
+}
+
+/*
+ * Helpers which finished a check in the keep-alive mode come back here to wait for the next one
+ */
+void QAuth::HelperPool::giveBack(SpawnedProcess *process, QIODevice *socket, qint64 id, int protocol) {
+    socket->setParent(this);
+    if (process) {
+        process->setParent(this);
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(helperExited()));
+        connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(helperExited()));
+    }
+
+    Helper &helper = m_helpers[id];
+    helper.process = process;
+    helper.socket = socket;
+    helper.protocol = protocol;
+    helper.idle.start();
+
+    // trims the pool if it's already full
+    refill();
+}
+
+
+QAuth::ForkServer::ForkServer()
+        : QObject() {
+}
+
+QAuth::ForkServer* QAuth::ForkServer::instance() {
+    if (!self.hasLocalData())
+        self.setLocalData(new ForkServer());
+    return self.localData();
+}
+
+void QAuth::ForkServer::start() {
+    if (m_process)
+        return;
+
+    id = Private::lastId++;
+    m_process = helperProcess(this);
+    connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(stop()));
+    connect(m_process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(stop()));
+
+    QStringList args;
+    args << "--fork-server";
+    args << "--socket" << SocketServer::instance()->address();
+    args << "--id" << QString("%1").arg(id);
+    // not used by the fork server itself, passed through to the children
+    args << "--protocol" << QString("%1").arg(PROTOCOL_LATEST);
+    args << "--batch";
+    args << HelperPool::instance()->keepAliveArgs();
+    m_process->start(QAUTH_HELPER_PATH, args);
+}
+
+/*
+ * Helpers forked before keep running, they're independent processes
+ */
+void QAuth::ForkServer::stop() {
+    qDeleteAll(m_aborted);
+    m_aborted.clear();
+    delete m_stream;
+    m_stream = nullptr;
+    if (m_socket) {
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+    if (m_process) {
+        disconnect(m_process, 0, this, 0);
+        m_process->deleteLater();
+        m_process = nullptr;
+    }
+    id = 0;
+}
+
+bool QAuth::ForkServer::running() const {
+    return m_socket && m_socket->state() == QLocalSocket::ConnectedState;
+}
+
+void QAuth::ForkServer::setSocket(QLocalSocket *socket) {
+    m_socket = socket;
+    m_socket->setParent(this);
+    delete m_stream;
+    m_stream = new SafeDataStream(m_socket);
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(dataPending()));
+    // let the pool make use of us right away
+    HelperPool::instance()->refill();
+}
+
+bool QAuth::ForkServer::fork(qint64 id) {
+    if (!running())
+        return false;
+    SafeDataStream &str = *m_stream;
+    str.reset();
+    str << Msg::FORK << id;
+    str.send();
+    return true;
+}
+
+/*
+ * Children have no process of ours to kill, the fork server does it for us
+ * if the aborted one doesn't quit on its own
+ */
+void QAuth::ForkServer::abort(qint64 id) {
+    if (!running() || m_aborted.contains(id))
+        return;
+    QTimer *timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), this, SLOT(abortTimedOut()));
+    timer->start(ABORT_GRACE_PERIOD);
+    m_aborted[id] = timer;
+}
+
+void QAuth::ForkServer::abortTimedOut() {
+    QTimer *timer = qobject_cast<QTimer*>(sender());
+    qint64 id = m_aborted.key(timer);
+    m_aborted.remove(id);
+    timer->deleteLater();
+    if (!running())
+        return;
+    SafeDataStream &str = *m_stream;
+    str.reset();
+    str << Msg::ABORT << id;
+    str.send();
+}
+
+void QAuth::ForkServer::dataPending() {
+    while (m_stream && m_stream->tryReceive()) {
+        Msg m = Msg::MSG_UNKNOWN;
+        qint64 id = 0;
+        qint32 exitCode = 0;
+        bool crashed = false;
+        SafeDataStream &str = *m_stream;
+        str >> m >> id >> exitCode >> crashed;
+        if (m != EXITED) {
+            qWarning() << " QAuth: Fork server: Received a wrong opcode instead of EXITED:" << m;
+            continue;
+        }
+        if (m_aborted.contains(id)) {
+            m_aborted.take(id)->deleteLater();
+            continue;
+        }
+        if (SocketServer::instance()->helpers.contains(id))
+            SocketServer::instance()->helpers[id]->childExited(exitCode, crashed ? QProcess::CrashExit : QProcess::NormalExit);
+        else
+            HelperPool::instance()->forkedExited(id);
     }
-    return self;
+}
+
+
+QAuth::Multiplexer::Multiplexer()
+        : QObject() {
+}
+
+QAuth::Multiplexer* QAuth::Multiplexer::instance() {
+    if (!self.hasLocalData())
+        self.setLocalData(new Multiplexer());
+    return self.localData();
+}
+
+void QAuth::Multiplexer::start() {
+    if (m_process)
+        return;
+
+    id = Private::lastId++;
+    m_process = helperProcess(this);
+    connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(stop()));
+    connect(m_process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(stop()));
+
+    QStringList args;
+    args << "--multiplex";
+    args << "--socket" << SocketServer::instance()->address();
+    args << "--id" << QString("%1").arg(id);
+    args << "--protocol" << QString("%1").arg(PROTOCOL_LATEST);
+    args << "--batch";
+    m_process->start(QAUTH_HELPER_PATH, args);
+}
+
+/*
+ * The conversations can't go on without the helper, their instances get finished(false)
+ */
+void QAuth::Multiplexer::stop() {
+    for (ChannelDevice *device : m_channels.values())
+        device->hangUp();
+    m_channels.clear();
+    qDeleteAll(m_aborted);
+    m_aborted.clear();
+    m_stuck = false;
+    delete m_stream;
+    m_stream = nullptr;
+    if (m_socket) {
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+    if (m_process) {
+        disconnect(m_process, 0, this, 0);
+        m_process->deleteLater();
+        m_process = nullptr;
+    }
+    id = 0;
+}
+
+bool QAuth::Multiplexer::running() const {
+    return m_socket && m_socket->state() == QLocalSocket::ConnectedState;
+}
+
+/*
+ * @return true if new checks can be sent to the helper
+ */
+bool QAuth::Multiplexer::available() const {
+    return running() && !m_stuck;
+}
+
+void QAuth::Multiplexer::setSocket(QLocalSocket *socket, int protocol) {
+    m_socket = socket;
+    m_socket->setParent(this);
+    this->protocol = protocol;
+    delete m_stream;
+    m_stream = new SafeDataStream(m_socket);
+    m_stream->setProtocol(protocol);
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(dataPending()));
+}
+
+ChannelDevice *QAuth::Multiplexer::open(qint64 channel, QObject *parent) {
+    ChannelDevice *device = new ChannelDevice(channel, parent);
+    connect(device, SIGNAL(outgoing(qint64,QByteArray)), this, SLOT(send(qint64,QByteArray)));
+    m_channels[channel] = device;
+    return device;
+}
+
+/*
+ * The helper learns about it too, in case the conversation is still going on
+ */
+void QAuth::Multiplexer::close(qint64 channel) {
+    ChannelDevice *device = m_channels.take(channel);
+    if (!device)
+        return;
+    device->close();
+    disconnect(device, 0, this, 0);
+    retireIfIdle();
+}
+
+/*
+ * The check on a channel closed in the middle gets a moment to end its PAM
+ * transaction. Its thread can't be killed, so a check stuck in a module
+ * only keeps new checks away from the helper, the ones running already
+ * get to finish before it's terminated.
+ */
+void QAuth::Multiplexer::abort(qint64 channel) {
+    if (!running() || m_aborted.contains(channel))
+        return;
+    QTimer *timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), this, SLOT(abortTimedOut()));
+    timer->start(ABORT_GRACE_PERIOD);
+    m_aborted[channel] = timer;
+}
+
+void QAuth::Multiplexer::abortTimedOut() {
+    QTimer *timer = qobject_cast<QTimer*>(sender());
+    qint64 channel = m_aborted.key(timer);
+    m_aborted.remove(channel);
+    timer->deleteLater();
+    if (!m_process)
+        return;
+    qWarning() << " QAuth: Multiplexer: Check" << channel << "didn't stop, the helper goes once the other checks are over";
+    m_stuck = true;
+    retireIfIdle();
+}
+
+void QAuth::Multiplexer::retireIfIdle() {
+    if (m_stuck && m_channels.isEmpty() && m_process)
+        m_process->terminate();
+}
+
+void QAuth::Multiplexer::send(qint64 channel, const QByteArray &chunk) {
+    if (!running())
+        return;
+    m_stream->reset();
+    *m_stream << channel;
+    writeBytes(*m_stream, chunk);
+    m_stream->send();
+}
+
+void QAuth::Multiplexer::dataPending() {
+    while (m_stream && m_stream->tryReceive()) {
+        qint64 channel = 0;
+        *m_stream >> channel;
+        QByteArray chunk = readBytes(*m_stream);
+        if (m_stream->status() != QDataStream::Ok) {
+            qWarning() << " QAuth: Multiplexer: Received a broken frame";
+            continue;
+        }
+        // nothing to do if the instance is finished or gone already
+        ChannelDevice *device = m_channels.value(channel, nullptr);
+        if (device)
+            device->deliver(chunk);
+        // the helper closes the channel too once the check is really over
+        else if (chunk.isEmpty() && m_aborted.contains(channel))
+            m_aborted.take(channel)->deleteLater();
+    }
+}
+
+
+QAuth::Scheduler::Scheduler()
+        : QObject() {
+}
+
+QAuth::Scheduler *QAuth::Scheduler::instance() {
+    if (!self.hasLocalData())
+        self.setLocalData(new Scheduler());
+    return self.localData();
+}
+
+/*
+ * Nothing jumps the queue, not even with the slot free
+ */
+bool QAuth::Scheduler::admit(Private *d) {
+    if (queue.contains(d))
+        return false;
+    if (maximum <= 0 || (running < maximum && queue.isEmpty())) {
+        d->admitted = true;
+        running++;
+        return true;
+    }
+
+    auto it = queue.begin();
+    while (it != queue.end() && (*it)->priority >= d->priority)
+        ++it;
+    queue.insert(it, d);
+    d->queued.start();
+    return false;
+}
+
+/*
+ * Called when the instance is finished, cancelled or gone, the next one is
+ * launched from the event loop, not from the middle of handling its signals
+ */
+void QAuth::Scheduler::release(Private *d) {
+    if (queue.removeOne(d))
+        return;
+    if (!d->admitted)
+        return;
+    d->admitted = false;
+    running--;
+    if (!queue.isEmpty())
+        QTimer::singleShot(0, this, SLOT(dispatch()));
+}
+
+void QAuth::Scheduler::dispatch() {
+    while ((maximum <= 0 || running < maximum) && !queue.isEmpty()) {
+        Private *d = queue.takeFirst();
+        qint64 wait = d->queued.elapsed();
+        waited++;
+        totalWait += wait;
+        maxWait = qMax(maxWait, wait);
+
+        d->admitted = true;
+        running++;
+        d->launch();
+    }
+}
+
+
+QAuth::Authenticator::Authenticator(const QString &user, const QByteArray &secret)
+        : QObject()
+        , m_auth(new QAuth(user, QString(), false, this))
+        , m_user(user.toUtf8())
+        , m_secret(ownedCopy(secret)) {
+    m_auth->setSecret(secret);
+    m_auth->setResponder(this);
+    connect(m_auth, SIGNAL(error(QString,QAuth::Error)), this, SLOT(error(QString,QAuth::Error)));
+    connect(m_auth, SIGNAL(authentication(QString,bool)), this, SLOT(authentication(QString,bool)));
+    connect(m_auth, SIGNAL(finished(bool)), this, SLOT(finished(bool)));
+}
+
+QAuth::Authenticator::~Authenticator() {
+    wipeSecret(m_secret);
+}
+
+QFuture<QAuth::AuthResult> QAuth::Authenticator::start() {
+    m_future.reportStarted();
+    m_auth->start();
+    return m_future.future();
+}
+
+/*
+ * Anything we can't answer stays empty and fails the check
+ */
+bool QAuth::Authenticator::respond(QList<QAuthResponder::Prompt> &prompts) {
+    for (QAuthResponder::Prompt &prompt : prompts) {
+        switch (prompt.type) {
+            case QAuthPrompt::LOGIN_USER:
+                prompt.response = m_user;
+                break;
+            case QAuthPrompt::LOGIN_PASSWORD:
+                prompt.response = m_secret;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+void QAuth::Authenticator::error(QString message, QAuth::Error type) {
+    m_result.error = type;
+    m_result.message = message;
+}
+
+void QAuth::Authenticator::authentication(QString user, bool success) {
+    if (success)
+        m_result.user = user;
+}
+
+void QAuth::Authenticator::finished(bool success) {
+    m_result.success = success;
+    m_future.reportResult(m_result);
+    m_future.reportFinished();
+    deleteLater();
 }
 
 
 QAuth::Private::Private(QAuth *parent)
         : QObject(parent)
         , request(new QAuthRequest(parent))
-        , child(new QProcess(this))
-        , id(lastId++) {
+        , id(lastId++)
+        , deadline(new QTimer(this)) {
     SocketServer::instance()->helpers[id] = this;
-    QProcessEnvironment env = child->processEnvironment();
-    env.insert("LANG", "C");
-    child->setProcessEnvironment(env);
-    connect(child, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(childExited(int,QProcess::ExitStatus)));
-    connect(child, SIGNAL(error(QProcess::ProcessError)), this, SLOT(childError(QProcess::ProcessError)));
+    setChild(helperProcess(this));
+    deadline->setSingleShot(true);
+    connect(deadline, SIGNAL(timeout()), this, SLOT(deadlinePassed()));
     connect(request, SIGNAL(finished()), this, SLOT(requestFinished()));
     connect(request, SIGNAL(promptsChanged()), parent, SIGNAL(requestChanged()));
 }
 
-void QAuth::Private::setSocket(QLocalSocket *socket) {
+QAuth::Private::~Private() {
+    wipeSecret(secret);
+    Scheduler::instance()->release(this);
+    SocketServer::instance()->helpers.remove(id);
+    closeConnection();
+}
+
+void QAuth::Private::setSocket(QIODevice *socket, int protocol) {
     this->socket = socket;
+    // sockets coming from the server would otherwise stay there until the server's gone
+    socket->setParent(this);
+    delete stream;
+    stream = new SafeDataStream(socket);
+    stream->setProtocol(protocol);
     connect(socket, SIGNAL(readyRead()), this, SLOT(dataPending()));
 }
 
+void QAuth::Private::setChild(SpawnedProcess *process) {
+    child = process;
+    child->setParent(this);
+    child->setProcessChannelMode(verbose ? QProcess::ForwardedChannels : QProcess::SeparateChannels);
+    connect(child, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(childExited(int,QProcess::ExitStatus)));
+    connect(child, SIGNAL(error(QProcess::ProcessError)), this, SLOT(childError(QProcess::ProcessError)));
+}
+
+void QAuth::Private::adopt(SpawnedProcess *process, QIODevice *socket, qint64 id, int protocol) {
+    SocketServer::instance()->helpers.remove(this->id);
+    this->id = id;
+    SocketServer::instance()->helpers[id] = this;
+
+    if (process) {
+        delete child;
+        setChild(process);
+    }
+    forked = !process;
+
+    socket->setParent(this);
+    setSocket(socket, protocol);
+}
+
+/*
+ * Hands a helper which finished a check in the keep-alive mode back to the pool
+ * and prepares a fresh process in case this instance gets started again
+ */
+void QAuth::Private::release() {
+    int protocol = stream->protocol();
+    disconnect(socket, 0, this, 0);
+    delete stream;
+    stream = nullptr;
+    SocketServer::instance()->helpers.remove(id);
+    if (forked) {
+        HelperPool::instance()->giveBack(nullptr, socket, id, protocol);
+    }
+    else {
+        disconnect(child, 0, this, 0);
+        HelperPool::instance()->giveBack(child, socket, id, protocol);
+        setChild(helperProcess(this));
+    }
+
+    socket = nullptr;
+    forked = false;
+    id = lastId++;
+    SocketServer::instance()->helpers[id] = this;
+}
+
+void QAuth::Private::openChannel() {
+    setSocket(Multiplexer::instance()->open(id, this), Multiplexer::instance()->protocol);
+    multiplexed = true;
+    connect(socket, SIGNAL(readChannelFinished()), this, SLOT(channelClosed()));
+}
+
+void QAuth::Private::closeChannel() {
+    disconnect(socket, 0, this, 0);
+    delete stream;
+    stream = nullptr;
+    Multiplexer::instance()->close(id);
+    socket->deleteLater();
+    socket = nullptr;
+    multiplexed = false;
+}
+
+/*
+ * Nothing more is coming from the helper, the connection goes away right now
+ * instead of waiting for the instance to be destroyed
+ */
+void QAuth::Private::closeConnection() {
+    if (multiplexed) {
+        closeChannel();
+        return;
+    }
+    delete stream;
+    stream = nullptr;
+    if (socket) {
+        disconnect(socket, 0, this, 0);
+        socket->deleteLater();
+        socket = nullptr;
+    }
+}
+
+/*
+ * The helper quit or gave up on the conversation without saying FINISHED
+ */
+void QAuth::Private::channelClosed() {
+    QAuth *auth = qobject_cast<QAuth*>(parent());
+    closeChannel();
+    Q_EMIT auth->error(QString("QAuth: The helper closed the connection"), ERROR_INTERNAL);
+    finish(false);
+}
+
+void QAuth::Private::finish(bool success) {
+    if (!active)
+        return;
+    active = false;
+    deadline->stop();
+    Scheduler::instance()->release(this);
+    Q_EMIT qobject_cast<QAuth*>(parent())->finished(success);
+}
+
+/*
+ * Closing the connection lets a helper waiting for us end the PAM transaction
+ * on its own, one still running after a moment is stuck in a module and gets
+ * SIGTERM, from the fork server for its children. Late messages from it
+ * can't reach this instance anymore, it's registered under a new ID.
+ */
+void QAuth::Private::abort(Error error, const QString &message) {
+    if (!active)
+        return;
+
+    bool wasMultiplexed = multiplexed;
+    closeConnection();
+    if (wasMultiplexed) {
+        Multiplexer::instance()->abort(id);
+    }
+    else if (forked) {
+        ForkServer::instance()->abort(id);
+    }
+    else if (child->state() != QProcess::NotRunning) {
+        SpawnedProcess *process = child;
+        disconnect(process, 0, this, 0);
+        // deleting the instance mustn't kill it and wait for it right away
+        process->setParent(SocketServer::instance());
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), process, SLOT(deleteLater()));
+        QTimer::singleShot(ABORT_GRACE_PERIOD, process, SLOT(terminate()));
+        setChild(helperProcess(this));
+    }
+    forked = false;
+
+    SocketServer::instance()->helpers.remove(id);
+    id = lastId++;
+    SocketServer::instance()->helpers[id] = this;
+
+    Q_EMIT qobject_cast<QAuth*>(parent())->error(message, error);
+    finish(false);
+}
+
+void QAuth::Private::deadlinePassed() {
+    abort(ERROR_TIMEOUT, QString("QAuth: The authentication took too long"));
+}
+
+void QAuth::Private::begin() {
+    sendCredentials();
+    sendEnvironment(environment);
+    SafeDataStream &str = *stream;
+    str.reset();
+    str << Msg::BEGIN << WireString(user) << WireString(sessionPath) << autologin;
+    // older helpers don't read that far, they just get a single attempt
+    if (maxAttempts > 1)
+        writeVarint(str, maxAttempts);
+    str.send();
+}
+
+/*
+ * Goes ahead of BEGIN, or first thing for helpers started with --credentials
+ */
+void QAuth::Private::sendCredentials() {
+    if (secret.isEmpty())
+        return;
+    SafeDataStream &str = *stream;
+    str.reset();
+    str << Msg::CREDENTIALS;
+    writeBytes(str, secret);
+    str.send();
+    wipeSecret(secret);
+}
+
+/*
+ * Since v3 the environment doesn't wait for AUTHENTICATED, it's sent as soon
+ * as there's a connection and every entry added later follows on its own
+ */
+void QAuth::Private::sendEnvironment(const QProcessEnvironment &env) {
+    if (!stream || stream->protocol() < PROTOCOL_V3 || sessionPath.isEmpty() || env.isEmpty())
+        return;
+    SafeDataStream &str = *stream;
+    str.reset();
+    str << Msg::ENVIRONMENT << env;
+    str.send();
+}
+
+/*
+ * Everything that arrived together gets handled at once, partial frames wait for more data
+ */
 void QAuth::Private::dataPending() {
+    // the stream goes away when the helper returns to the pool after FINISHED
+    while (stream && stream->tryReceive()) {
+        // batched frames carry several messages, only the last one can expect a reply
+        do
+            handleMessage();
+        while (stream && !stream->atFrameEnd());
+    }
+}
+
+void QAuth::Private::handleMessage() {
     QAuth *auth = qobject_cast<QAuth*>(parent());
     Msg m = MSG_UNKNOWN;
-    SafeDataStream str(socket);
-    str.receive();
+    SafeDataStream &str = *stream;
     str >> m;
     switch (m) {
         case ERROR: {
             QString message;
             Error type;
-            str >> message >> type;
+            str >> WireString(message) >> type;
             Q_EMIT auth->error(message, type);
             break;
         }
         case INFO: {
             QString message;
             Info type;
-            str >> message >> type;
+            str >> WireString(message) >> type;
             Q_EMIT auth->info(message, type);
             break;
         }
         case REQUEST: {
             Request r;
             str >> r;
+            if (responder && respond(r))
+                break;
             request->setRequest(&r);
             break;
         }
         case AUTHENTICATED: {
             QString user;
-            str >> user;
+            str >> WireString(user);
             if (!user.isEmpty()) {
                 auth->setUser(user);
                 Q_EMIT auth->authentication(user, true);
-                str.reset();
-                str << AUTHENTICATED << environment;
-                str.send();
+                // v3 helpers already have the environment, the ones starting
+                // a session only wait to hear the handlers added nothing more
+                if (str.protocol() < PROTOCOL_V3) {
+                    str.reset();
+                    str << AUTHENTICATED << environment;
+                    str.send();
+                }
+                else if (!sessionPath.isEmpty() && stream) {
+                    str.reset();
+                    str << ENVIRONMENT << QProcessEnvironment();
+                    str.send();
+                }
             }
             else {
                 Q_EMIT auth->authentication(user, false);
@@ -172,10 +1244,25 @@ void QAuth::Private::dataPending() {
         case SESSION_STATUS: {
             bool status;
             str >> status;
+            // the session can run as long as it wants, without taking anyone's turn
+            deadline->stop();
+            Scheduler::instance()->release(this);
             Q_EMIT auth->session(status);
-            str.reset();
-            str << SESSION_STATUS;
-            str.send();
+            if (str.protocol() < PROTOCOL_V3) {
+                str.reset();
+                str << SESSION_STATUS;
+                str.send();
+            }
+            break;
+        }
+        case FINISHED: {
+            qint32 status;
+            str >> status;
+            if (multiplexed)
+                closeChannel();
+            else
+                release();
+            finish(status == 0);
             break;
         }
         default: {
@@ -185,24 +1272,127 @@ void QAuth::Private::dataPending() {
 }
 
 void QAuth::Private::childExited(int exitCode, QProcess::ExitStatus exitStatus) {
+    // the exit can be noticed before the last messages, they still count
+    if (stream) {
+        do
+            dataPending();
+        while (stream && socket->waitForReadyRead(0));
+    }
+    closeConnection();
     if (exitStatus != QProcess::NormalExit)
         Q_EMIT qobject_cast<QAuth*>(parent())->error(child->errorString(), ERROR_INTERNAL);
-    Q_EMIT qobject_cast<QAuth*>(parent())->finished(!exitCode);
+    finish(!exitCode);
 }
 
 void QAuth::Private::childError(QProcess::ProcessError error) {
-    Q_UNUSED(error);
     Q_EMIT qobject_cast<QAuth*>(parent())->error(child->errorString(), ERROR_INTERNAL);
+    // there's no finished() coming after this one, the check ends here
+    if (error == QProcess::FailedToStart) {
+        closeConnection();
+        finish(false);
+    }
 }
 
 void QAuth::Private::requestFinished() {
-    SafeDataStream str(socket);
-    Request r = request->request();
-    str << REQUEST << r;
+    SafeDataStream &str = *stream;
+    str.reset();
+    str << REQUEST << Responses(request->request());
     str.send();
     request->setRequest();
 }
 
+/*
+ * Answers without the prompt objects and the signals, @return false if the responder passed
+ */
+bool QAuth::Private::respond(Request &r) {
+    QList<QAuthResponder::Prompt> prompts;
+    prompts.reserve(r.prompts.length());
+    for (const Prompt &p : r.prompts) {
+        QAuthResponder::Prompt prompt;
+        prompt.type = p.type;
+        prompt.message = p.message;
+        prompt.hidden = p.hidden;
+        prompts << prompt;
+    }
+
+    bool answered = responder->respond(prompts);
+    if (answered && prompts.length() == r.prompts.length()) {
+        // the responder wipes its own copies, ours are gone once they're sent
+        for (int i = 0; i < prompts.length(); i++)
+            r.prompts[i].response = ownedCopy(prompts[i].response);
+        SafeDataStream &str = *stream;
+        str.reset();
+        str << REQUEST << Responses(r);
+        str.send();
+        for (Prompt &p : r.prompts)
+            wipeSecret(p.response);
+    }
+    else if (answered) {
+        qWarning() << " QAuth: The responder changed the number of prompts, ignoring its answers";
+        answered = false;
+    }
+    for (QAuthResponder::Prompt &prompt : prompts)
+        wipeSecret(prompt.response);
+    return answered;
+}
+
+void QAuth::Private::launch() {
+    QAuth *auth = qobject_cast<QAuth*>(parent());
+    SpawnedProcess *process = nullptr;
+    QIODevice *socket = nullptr;
+    qint64 id = 0;
+    int protocol = PROTOCOL_V1;
+
+    // checks go to the resident helper if there's one
+    if (!auth->verbose() && sessionPath.isEmpty() && Multiplexer::instance()->available()) {
+        openChannel();
+        begin();
+        return;
+    }
+
+    if (!auth->verbose() && HelperPool::instance()->take(&process, &socket, &id, &protocol)) {
+        adopt(process, socket, id, protocol);
+        begin();
+        return;
+    }
+
+    // the forked helper gets BEGIN as soon as it connects
+    if (!auth->verbose() && ForkServer::instance()->fork(this->id)) {
+        forked = true;
+        return;
+    }
+
+    QList<int> childFds;
+    QStringList args = SocketServer::instance()->connectionArgs(this->id, this, &socket, &childFds);
+    if (!sessionPath.isEmpty())
+        args << "--start" << sessionPath;
+    if (!user.isEmpty())
+        args << "--user" << user;
+    if (autologin)
+        args << "--autologin";
+    if (!secret.isEmpty())
+        args << "--credentials";
+    if (maxAttempts > 1)
+        args << "--attempts" << QString::number(maxAttempts);
+    if (!auth->verbose())
+        args << HelperPool::instance()->keepAliveArgs();
+    child->setInheritedFds(childFds);
+    bool started = child->start(QAUTH_HELPER_PATH, args);
+
+    for (int fd : childFds)
+        close(fd);
+    // childError already finished the check
+    if (!started) {
+        delete socket;
+        return;
+    }
+    if (socket) {
+        setSocket(socket, PROTOCOL_LATEST);
+        sendCredentials();
+        sendEnvironment(environment);
+    }
+}
+
 
 QAuth::QAuth(const QString &user, const QString &session, bool autologin, QObject *parent, bool verbose)
         : QObject(parent)
@@ -228,6 +1418,116 @@ void QAuth::registerTypes() {
     qmlRegisterType<QAuth>("QAuth", 1, 0, "QAuth");
 }
 
+void QAuth::setHelperPoolSize(int size) {
+    HelperPool::instance()->size = qMax(0, size);
+    HelperPool::instance()->refill();
+}
+
+int QAuth::helperPoolSize() {
+    return HelperPool::instance()->size;
+}
+
+quint64 QAuth::helperPoolHits() {
+    return HelperPool::instance()->hits;
+}
+
+quint64 QAuth::helperPoolMisses() {
+    return HelperPool::instance()->misses;
+}
+
+void QAuth::setHelperForkServer(bool on) {
+    if (on)
+        ForkServer::instance()->start();
+    else
+        ForkServer::instance()->stop();
+}
+
+bool QAuth::helperForkServer() {
+    return ForkServer::instance()->running();
+}
+
+QFuture<QAuth::AuthResult> QAuth::authenticate(const QString &user, const QByteArray &secret) {
+    Authenticator *authenticator = new Authenticator(user, secret);
+    return authenticator->start();
+}
+
+void QAuth::setPriority(int priority) {
+    d->priority = priority;
+}
+
+int QAuth::priority() const {
+    return d->priority;
+}
+
+void QAuth::setResponder(QAuthResponder *responder) {
+    d->responder = responder;
+}
+
+QAuthResponder *QAuth::responder() const {
+    return d->responder;
+}
+
+void QAuth::setMaxConcurrentHelpers(int max) {
+    Scheduler::instance()->maximum = qMax(0, max);
+    Scheduler::instance()->dispatch();
+}
+
+int QAuth::maxConcurrentHelpers() {
+    return Scheduler::instance()->maximum;
+}
+
+int QAuth::queueDepth() {
+    return Scheduler::instance()->queue.size();
+}
+
+qint64 QAuth::averageQueueWait() {
+    Scheduler *scheduler = Scheduler::instance();
+    if (scheduler->waited == 0)
+        return 0;
+    return scheduler->totalWait / qint64(scheduler->waited);
+}
+
+qint64 QAuth::maxQueueWait() {
+    return Scheduler::instance()->maxWait;
+}
+
+void QAuth::cancel() {
+    d->abort(ERROR_CANCELLED, QString("QAuth: The authentication was cancelled"));
+}
+
+void QAuth::setDeadline(int msecs) {
+    d->deadline->setInterval(qMax(0, msecs));
+}
+
+int QAuth::deadline() const {
+    return d->deadline->interval();
+}
+
+void QAuth::setMaxAttempts(int attempts) {
+    d->maxAttempts = qMax(1, attempts);
+}
+
+int QAuth::maxAttempts() const {
+    return d->maxAttempts;
+}
+
+void QAuth::setHelperTransport(Transport transport) {
+    SocketServer::instance()->transport = transport;
+    if (transport == TRANSPORT_MULTIPLEXED)
+        Multiplexer::instance()->start();
+    else
+        Multiplexer::instance()->stop();
+}
+
+QAuth::Transport QAuth::helperTransport() {
+    return SocketServer::instance()->transport;
+}
+
+void QAuth::setHelperKeepAlive(int idleTimeout, int maxChecks) {
+    HelperPool::instance()->keepAliveTimeout = qMax(0, idleTimeout);
+    HelperPool::instance()->keepAliveChecks = qMax(0, maxChecks);
+}
+
 bool QAuth::autologin() const {
     return d->autologin;
 }
@@ -241,7 +1541,7 @@ const QString &QAuth::user() const {
 }
 
 bool QAuth::verbose() const {
-    return d->child->processChannelMode() == QProcess::ForwardedChannels;
+    return d->verbose;
 }
 
 QAuthRequest *QAuth::request() {
@@ -250,10 +1550,14 @@ QAuthRequest *QAuth::request() {
 
 void QAuth::insertEnvironment(const QProcessEnvironment &env) {
     d->environment.insert(env);
+    d->sendEnvironment(env);
 }
 
 void QAuth::insertEnvironment(const QString &key, const QString &value) {
     d->environment.insert(key, value);
+    QProcessEnvironment env;
+    env.insert(key, value);
+    d->sendEnvironment(env);
 }
 
 void QAuth::setUser(const QString &user) {
@@ -263,6 +1567,11 @@ void QAuth::setUser(const QString &user) {
     }
 }
 
+void QAuth::setSecret(const QByteArray &secret) {
+    wipeSecret(d->secret);
+    d->secret = ownedCopy(secret);
+}
+
 void QAuth::setAutologin(bool on) {
     if (on != d->autologin) {
         d->autologin = on;
@@ -278,26 +1587,20 @@ void QAuth::setSession(const QString& path) {
 }
 
 void QAuth::setVerbose(bool on) {
-    if (on != verbose()) {
-        if (on)
-            d->child->setProcessChannelMode(QProcess::ForwardedChannels);
-        else
-            d->child->setProcessChannelMode(QProcess::SeparateChannels);
+    if (on != d->verbose) {
+        d->verbose = on;
+        d->child->setProcessChannelMode(on ? QProcess::ForwardedChannels : QProcess::SeparateChannels);
         Q_EMIT verboseChanged();
     }
 }
 
 void QAuth::start() {
-    QStringList args;
-    args << "--socket" << SocketServer::instance()->fullServerName();
-    args << "--id" << QString("%1").arg(d->id);
-    if (!d->sessionPath.isEmpty())
-        args << "--start" << d->sessionPath;
-    if (!d->user.isEmpty())
-        args << "--user" << d->user;
-    if (d->autologin)
-        args << "--autologin";
-    d->child->start(QAUTH_HELPER_PATH, args);
+    d->active = true;
+    if (d->deadline->interval() > 0)
+        d->deadline->start();
+    // with too many helpers running already, it waits for its turn
+    if (Scheduler::instance()->admit(d))
+        d->launch();
 }
 
 #include "QAuth.moc"
@@ -0,0 +1,187 @@
+/*
+ * Qt Authentication Library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include "batch.h"
+#include "qauth.h"
+#include "Messages.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+
+class QAuthBatch::Private : public QObject {
+    Q_OBJECT
+public slots:
+    void checkFinished();
+public:
+    Private(QAuthBatch *parent);
+    void next();
+
+    struct Credentials {
+        int index { 0 };
+        QString user { };
+        QByteArray secret { };
+    };
+    struct Check {
+        int index { 0 };
+        QString user { };
+        QElapsedTimer started { };
+    };
+
+    QList<Credentials> queue { };
+    QHash<QObject*, Check> running { }; ///< by their watchers
+    int concurrency { 4 };
+    int count { 0 }; ///< added over the lifetime of the batch, numbers the checks
+    int completed { 0 };
+    int succeeded { 0 };
+    qint64 totalLatency { 0 };
+    qint64 maxLatency { 0 };
+    QElapsedTimer elapsed { };
+    qint64 duration { 0 }; ///< of the last finished run, while idle
+};
+
+QAuthBatch::Private::Private(QAuthBatch *parent)
+        : QObject(parent) { }
+
+/*
+ * Fills the free slots, the secrets don't stay around any longer than needed
+ */
+void QAuthBatch::Private::next() {
+    while (running.size() < concurrency && !queue.isEmpty()) {
+        Credentials credentials = queue.takeFirst();
+        QFutureWatcher<QAuth::AuthResult> *watcher = new QFutureWatcher<QAuth::AuthResult>(this);
+        connect(watcher, SIGNAL(finished()), this, SLOT(checkFinished()));
+
+        Check &check = running[watcher];
+        check.index = credentials.index;
+        check.user = credentials.user;
+        check.started.start();
+
+        watcher->setFuture(QAuth::authenticate(credentials.user, credentials.secret));
+        wipeSecret(credentials.secret);
+    }
+}
+
+void QAuthBatch::Private::checkFinished() {
+    QAuthBatch *batch = qobject_cast<QAuthBatch*>(parent());
+    QFutureWatcher<QAuth::AuthResult> *watcher = static_cast<QFutureWatcher<QAuth::AuthResult>*>(sender());
+    Check check = running.take(watcher);
+    bool success = watcher->result().success;
+    watcher->deleteLater();
+
+    qint64 latency = check.started.elapsed();
+    totalLatency += latency;
+    maxLatency = qMax(maxLatency, latency);
+    completed++;
+    if (success)
+        succeeded++;
+
+    next();
+    if (running.isEmpty())
+        duration = elapsed.elapsed();
+
+    Q_EMIT batch->result(check.index, check.user, success);
+    if (running.isEmpty())
+        Q_EMIT batch->finished();
+}
+
+QAuthBatch::QAuthBatch(QObject *parent)
+        : QObject(parent)
+        , d(new Private(this)) { }
+
+QAuthBatch::~QAuthBatch() {
+    for (auto it = d->queue.begin(); it != d->queue.end(); ++it)
+        wipeSecret(it->secret);
+}
+
+void QAuthBatch::add(const QString &user, const QByteArray &secret) {
+    Private::Credentials credentials;
+    credentials.index = d->count++;
+    credentials.user = user;
+    credentials.secret = ownedCopy(secret);
+    d->queue << credentials;
+    // keeps the pipeline full if it's already running
+    if (!d->running.isEmpty())
+        d->next();
+}
+
+int QAuthBatch::count() const {
+    return d->count;
+}
+
+int QAuthBatch::completed() const {
+    return d->completed;
+}
+
+int QAuthBatch::succeeded() const {
+    return d->succeeded;
+}
+
+qreal QAuthBatch::throughput() const {
+    qint64 duration = d->running.isEmpty() ? d->duration : d->elapsed.elapsed();
+    if (duration <= 0)
+        return 0;
+    return d->completed * 1000.0 / duration;
+}
+
+qint64 QAuthBatch::averageLatency() const {
+    if (d->completed == 0)
+        return 0;
+    return d->totalLatency / d->completed;
+}
+
+qint64 QAuthBatch::maxLatency() const {
+    return d->maxLatency;
+}
+
+int QAuthBatch::concurrency() const {
+    return d->concurrency;
+}
+
+void QAuthBatch::setConcurrency(int concurrency) {
+    concurrency = qMax(1, concurrency);
+    if (concurrency != d->concurrency) {
+        d->concurrency = concurrency;
+        if (!d->running.isEmpty())
+            d->next();
+        Q_EMIT concurrencyChanged();
+    }
+}
+
+void QAuthBatch::start() {
+    if (!d->running.isEmpty())
+        return;
+    if (d->queue.isEmpty()) {
+        Q_EMIT finished();
+        return;
+    }
+    // only what was run since now counts, the indexes keep going
+    d->completed = 0;
+    d->succeeded = 0;
+    d->totalLatency = 0;
+    d->maxLatency = 0;
+    d->duration = 0;
+    d->elapsed.start();
+    d->next();
+}
+
+#include "moc_batch.moc"
+#include "QAuthBatch.moc"
@@ -66,4 +66,32 @@ bool QAuthPrompt::hidden() const {
     return d->hidden;
 }
 
+/*
+ * Takes over the values of a prompt of another round
+ */
+void QAuthPrompt::update(const Prompt *prompt) {
+    if (prompt->type != d->type) {
+        d->type = prompt->type;
+        Q_EMIT typeChanged();
+    }
+    if (prompt->message != d->message) {
+        d->message = prompt->message;
+        Q_EMIT messageChanged();
+    }
+    if (prompt->hidden != d->hidden) {
+        d->hidden = prompt->hidden;
+        Q_EMIT hiddenChanged();
+    }
+    setResponse(prompt->response);
+}
+
+/*
+ * Overwrites the response before the prompt is put aside, silently,
+ * nobody should be looking at it anymore
+ */
+void QAuthPrompt::wipe() {
+    d->response.fill(0);
+    d->response.clear();
+}
+
 #include "moc_prompt.moc"
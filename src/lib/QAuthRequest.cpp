@@ -30,6 +30,8 @@ public slots:
 public:
     Private(QObject *parent);
     QList<QAuthPrompt*> prompts { };
+    QList<QAuthPrompt*> spare { }; ///< prompts of earlier rounds waiting to be reused
+    Request current { }; ///< as received, only the responses get updated
     bool finishAutomatically { false };
     bool finished { true };
 };
@@ -50,22 +52,43 @@ QAuthRequest::QAuthRequest(QAuth *parent)
         : QObject(parent)
         , d(new Private(this)) { }
 
+/*
+ * The prompts are updated in place, new ones are created only when
+ * a round has more prompts than any before it
+ */
 void QAuthRequest::setRequest(const Request *request) {
-    QList<QAuthPrompt*> promptsCopy(d->prompts);
-    d->prompts.clear();
-    if (request != nullptr) {
-        Q_FOREACH (const Prompt& p, request->prompts) {
+    int count = request ? request->prompts.length() : 0;
+    while (d->prompts.length() > count) {
+        QAuthPrompt *qap = d->prompts.takeLast();
+        qap->wipe();
+        d->spare << qap;
+    }
+    for (int i = 0; i < count; i++) {
+        const Prompt &p = request->prompts[i];
+        if (i < d->prompts.length()) {
+            d->prompts[i]->update(&p);
+        }
+        else if (!d->spare.isEmpty()) {
+            QAuthPrompt *qap = d->spare.takeLast();
+            d->prompts << qap;
+            qap->update(&p);
+        }
+        else {
             QAuthPrompt *qap = new QAuthPrompt(&p, this);
+            // finishAutomatically is checked in the slot, it can change any time
+            connect(qap, SIGNAL(responseChanged()), d, SLOT(responseChanged()));
             d->prompts << qap;
-            if (finishAutomatically())
-                connect(qap, SIGNAL(responseChanged()), d, SLOT(responseChanged()));
         }
+    }
+
+    if (request != nullptr) {
+        d->current = *request;
         d->finished = false;
     }
-    Q_EMIT promptsChanged();
-    if (request == nullptr) {
-        qDeleteAll(promptsCopy);
+    else {
+        d->current.clear();
     }
+    Q_EMIT promptsChanged();
 }
 
 QList<QAuthPrompt*> QAuthRequest::prompts() {
@@ -100,17 +123,13 @@ void QAuthRequest::setFinishAutomatically(bool value) {
     }
 }
 
-Request QAuthRequest::request() const {
-    Request r;
-    Q_FOREACH (const QAuthPrompt* qap, d->prompts) {
-        Prompt p;
-        p.hidden = qap->hidden();
-        p.message = qap->message();
-        p.response = qap->response();
-        p.type = qap->type();
-        r.prompts << p;
-    }
-    return r;
+/*
+ * Everything but the responses is still what the helper sent
+ */
+const Request &QAuthRequest::request() const {
+    for (int i = 0; i < d->prompts.length(); i++)
+        d->current.prompts[i].response = d->prompts[i]->response();
+    return d->current;
 }
 
 #include "moc_request.moc"
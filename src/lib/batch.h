@@ -0,0 +1,116 @@
+/*
+ * Qt Authentication library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QtCore/QObject>
+
+/**
+ * \brief
+ * Verifies many user/secret pairs at once
+ *
+ * \section description
+ * Add the credentials with \ref add and fire up \ref start. At most
+ * \ref concurrency checks run at the same time, every finished one makes
+ * room for the next, so the helpers never sit idle while something's left.
+ * The results come with \ref result as soon as each check finishes,
+ * not in the order they were added.
+ *
+ * Each check is a \ref QAuth::authenticate call, so the helper settings
+ * apply: with \ref QAuth::TRANSPORT_MULTIPLEXED all checks share one helper
+ * connection, with a pool and keep-alive the helpers serve one check after
+ * another.
+ */
+class QAuthBatch : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(int concurrency READ concurrency WRITE setConcurrency NOTIFY concurrencyChanged)
+public:
+    explicit QAuthBatch(QObject *parent = 0);
+    ~QAuthBatch();
+
+    /**
+     * Queues a check, can be called while the batch is running too
+     * @param user username
+     * @param secret the password, the batch wipes its own copy as soon as the check starts
+     */
+    void add(const QString &user, const QByteArray &secret);
+
+    /**
+     * @return number of checks added since the batch was created
+     */
+    int count() const;
+    /**
+     * @return number of checks which already finished
+     */
+    int completed() const;
+    /**
+     * @return number of checks which finished successfully
+     */
+    int succeeded() const;
+
+    /**
+     * @return checks finished per second since \ref start
+     */
+    qreal throughput() const;
+    /**
+     * @return average time (in ms) from starting a check to its result
+     */
+    qint64 averageLatency() const;
+    /**
+     * @return longest time (in ms) from starting a check to its result
+     */
+    qint64 maxLatency() const;
+
+    int concurrency() const;
+    /**
+     * @param concurrency how many checks (helpers) at most run at once, 4 by default
+     */
+    void setConcurrency(int concurrency);
+
+public Q_SLOTS:
+    /**
+     * Starts the queued checks, resets the statistics if the batch was idle
+     */
+    void start();
+
+Q_SIGNALS:
+    void concurrencyChanged();
+
+    /**
+     * Emitted as soon as one check finishes
+     *
+     * @param index position of the check in the order of \ref add calls
+     * @param user username
+     * @param success true if the secret was right
+     */
+    void result(int index, QString user, bool success);
+
+    /**
+     * Emitted when no check is left, neither queued nor running
+     */
+    void finished();
+
+private:
+    class Private;
+    Private *d { nullptr };
+};
+
+#endif // BATCH_H
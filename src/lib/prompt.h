@@ -36,13 +36,16 @@ class Prompt;
  * \warning Don't use the \ref message property if you have your own strings for
  *      the \ref Type -s. PAM sends horrible horrible stuff and passwd obviously
  *      doesn't tell us a thing.
+ *
+ * The objects are kept by their \ref QAuthRequest and reused for the prompts
+ * of the following rounds, each property notifies when it changes.
  */
 class QAuthPrompt : public QObject {
     Q_OBJECT
     Q_ENUMS(Type)
-    Q_PROPERTY(Type type READ type CONSTANT)
-    Q_PROPERTY(QString message READ message CONSTANT)
-    Q_PROPERTY(bool hidden READ hidden CONSTANT)
+    Q_PROPERTY(Type type READ type NOTIFY typeChanged)
+    Q_PROPERTY(QString message READ message NOTIFY messageChanged)
+    Q_PROPERTY(bool hidden READ hidden NOTIFY hiddenChanged)
     Q_PROPERTY(QByteArray response WRITE setResponse NOTIFY responseChanged)
 public:
     virtual ~QAuthPrompt();
@@ -81,9 +84,14 @@ Q_SIGNALS:
      * Emitted when the response was entered by the user
      */
     void responseChanged();
+    void typeChanged();
+    void messageChanged();
+    void hiddenChanged();
 private:
     QAuthPrompt(const Prompt *prompt, QAuthRequest *parent = 0);
     QByteArray response() const;
+    void update(const Prompt *prompt);
+    void wipe();
     friend class QAuthRequest;
     class Private;
     Private *d { nullptr };
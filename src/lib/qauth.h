@@ -23,7 +23,9 @@
 
 #include "request.h"
 #include "prompt.h"
+#include "responder.h"
 
+#include <QtCore/QFuture>
 #include <QtCore/QObject>
 #include <QtCore/QProcessEnvironment>
 
@@ -46,6 +48,17 @@
  *
  * Just construct, connect the signals (especially \ref requestChanged)
  * and fire up \ref start
+ *
+ * For plain checks where the secret is known up front, \ref authenticate
+ * does all of that and returns a future instead.
+ *
+ * \section threads
+ * Instances can be created in any thread running an event loop, several
+ * threads at once included. Every thread gets its own local server, helper
+ * pool, fork server and resident helper, so an instance is served entirely
+ * by the event loop of its thread and threads don't wait for each other.
+ * The static helper settings apply only to the thread calling them. An
+ * instance must not be moved to another thread.
  */
 class QAuth : public QObject {
     Q_OBJECT
@@ -72,11 +85,151 @@ public:
         ERROR_UNKNOWN,
         ERROR_AUTHENTICATION,
         ERROR_INTERNAL,
+        ERROR_CANCELLED,  ///< \ref cancel was called
+        ERROR_TIMEOUT,    ///< the \ref deadline passed
         _ERROR_LAST
     };
 
+    enum Transport {
+        TRANSPORT_LOCAL_SERVER = 0, ///< Helpers connect to a local server and identify themselves
+        TRANSPORT_SOCKETPAIR,       ///< Helpers inherit their end of a socketpair
+        TRANSPORT_MULTIPLEXED,      ///< One resident helper serves all checks over one connection
+        TRANSPORT_SHARED_MEMORY,    ///< Helpers inherit ring buffers in shared memory
+        _TRANSPORT_LAST
+    };
+
+    /**
+     * Outcome of \ref authenticate
+     */
+    struct AuthResult {
+        bool success { false };
+        QString user { };                ///< the authenticated user, empty on failure
+        Error error { ERROR_NONE };      ///< the last error reported
+        QString message { };             ///< message of the last error
+    };
+
     static void registerTypes();
 
+    /**
+     * Checks \p secret of \p user without any signals to connect
+     *
+     * Starts a check on an instance of its own, answering the user name
+     * prompts with \p user and the password ones with \p secret. Other
+     * prompts (changing an expired password) are left empty and the check
+     * fails. The check runs in the event loop of the calling thread and the
+     * instance deletes itself when it's finished.
+     *
+     * With C++20 coroutines and Qt 5, the future can be co_await-ed directly.
+     *
+     * @param user username
+     * @param secret the password
+     * @return the result, available once the helper finishes
+     */
+    static QFuture<AuthResult> authenticate(const QString &user, const QByteArray &secret);
+
+    /**
+     * Keeps \p size helper processes started and connected in advance, so
+     * \ref start only has to tell one of them what to do instead of waiting
+     * for it to launch. The pool refills itself in the background.
+     *
+     * Disabled (size 0) by default. Verbose instances always start their own helper.
+     * @param size number of idle helpers to keep around
+     */
+    static void setHelperPoolSize(int size);
+    static int helperPoolSize();
+
+    /**
+     * @return number of times \ref start got an idle helper from the pool
+     */
+    static quint64 helperPoolHits();
+
+    /**
+     * @return number of times \ref start had to launch a new helper despite the pool being enabled
+     */
+    static quint64 helperPoolMisses();
+
+    /**
+     * Sets how newly launched helpers talk to the library.
+     *
+     * With \ref TRANSPORT_SOCKETPAIR the helper gets its connection already
+     * open, without the rendezvous on the named local server. Helpers coming
+     * from the fork server still connect to the local server.
+     *
+     * With \ref TRANSPORT_MULTIPLEXED, one resident helper is started and
+     * every instance without a session is served by a thread in it, over
+     * the helper's single connection. Instances starting a session and
+     * verbose ones still get their own helper. Switching to another
+     * transport stops the resident helper and fails the checks it's running.
+     * The helper makes one PAM call at a time, a module waiting for the user
+     * in the middle of one holds up the other checks until it's answered.
+     * The password given with \ref setSecret needs no such round trip.
+     * A check still stuck in a module after it was aborted keeps new checks
+     * away from the resident helper, which is stopped once the others are over.
+     *
+     * With \ref TRANSPORT_SHARED_MEMORY the helper inherits a memfd with
+     * a ring buffer for each direction, frames are copied in and out of it
+     * without any syscall unless the other side is asleep. Falls back to the
+     * local server where memfd isn't available, forked helpers connect to
+     * the local server as well.
+     *
+     * @param transport the transport, \ref TRANSPORT_LOCAL_SERVER by default
+     */
+    static void setHelperTransport(Transport transport);
+    static Transport helperTransport();
+
+    /**
+     * Lets helpers doing only a check (no session set) wait for another one
+     * instead of quitting. Finished helpers go back to the pool, so this
+     * has an effect only when \ref setHelperPoolSize is used too.
+     *
+     * @param idleTimeout how long (in ms) a helper waits for the next check, 0 disables keep-alive
+     * @param maxChecks how many checks one helper serves before quitting, 0 for no limit
+     */
+    static void setHelperKeepAlive(int idleTimeout, int maxChecks = 0);
+
+    /**
+     * Starts one resident helper which preloads the PAM modules and forks
+     * itself for every new helper, so new helpers skip exec and dynamic
+     * linking and are ready almost immediately. Applies both to the pool
+     * and to instances started directly. Helpers are launched normally
+     * until the fork server connects or when it dies.
+     *
+     * @param on true to start the fork server, false to stop it
+     */
+    static void setHelperForkServer(bool on = true);
+
+    /**
+     * @return true if the fork server is up and serving
+     */
+    static bool helperForkServer();
+
+    /**
+     * Limits how many instances can be running at once. Instances started
+     * above the limit wait in a queue, the ones with a higher \ref priority
+     * first, in the order they were started otherwise. The signals don't
+     * change, a queued instance just takes longer. An instance stops
+     * counting once it's finished or its session is started.
+     *
+     * @param max the limit, 0 (default) for none
+     */
+    static void setMaxConcurrentHelpers(int max);
+    static int maxConcurrentHelpers();
+
+    /**
+     * @return number of instances waiting for their turn right now
+     */
+    static int queueDepth();
+
+    /**
+     * @return average time (in ms) instances waited in the queue, counting only those which had to wait
+     */
+    static qint64 averageQueueWait();
+
+    /**
+     * @return longest time (in ms) an instance waited in the queue
+     */
+    static qint64 maxQueueWait();
+
     bool autologin() const;
     bool verbose() const;
     const QString &user() const;
@@ -87,6 +240,9 @@ public:
      * If starting a session, you will probably want to provide some basic env variables for the session.
      * This only inserts the variables - if the current key already had a value, it will be overwritten.
      * User-specific data such as $HOME is generated automatically.
+     * The environment is sent to the helper as soon as it's connected, entries inserted
+     * later follow one by one. Entries inserted after the authentication() signal
+     * has been handled may arrive too late for the session.
      * @param env the environment
      */
     void insertEnvironment(const QProcessEnvironment &env);
@@ -117,18 +273,75 @@ public:
      */
     void setUser(const QString &user);
 
+    /**
+     * Hands the password to the helper when it starts, so the login prompts
+     * are answered right in the helper without any \ref requestChanged.
+     * Only the prompts it can't answer still make the round trip. The
+     * secret goes over the helper's connection, never on its command line,
+     * and the copy kept here is wiped once it's sent, so it's good for one
+     * \ref start. Wiping \p secret itself is up to the caller.
+     * @param secret the password
+     */
+    void setSecret(const QByteArray &secret);
+
     /**
      * Set the session to be started after authenticating.
      * @param path Path of the session executable to be started
      */
     void setSession(const QString &path);
 
+    /**
+     * Limits how long \ref start can take to finish, including the time the
+     * user spends answering the prompts. When it passes, the instance is
+     * stopped like with \ref cancel, only with \ref ERROR_TIMEOUT. Once a session
+     * is started, it runs as long as it needs.
+     * @param msecs the limit, 0 (default) for none
+     */
+    void setDeadline(int msecs);
+    int deadline() const;
+
+    /**
+     * Lets the user try again after a failed authentication, in the same
+     * helper and over the same connection. Every failed attempt emits
+     * \ref authentication with false and, while attempts are left, the
+     * prompts come again with \ref requestChanged. A secret set with
+     * \ref setSecret is used only for the first attempt.
+     * @param attempts the limit, 1 (default) for a single attempt
+     */
+    void setMaxAttempts(int attempts);
+    int maxAttempts() const;
+
+    /**
+     * Sets the order in the queue when \ref setMaxConcurrentHelpers is used,
+     * e.g. an interactive greeter above background checks
+     * @param priority higher goes first, 0 by default
+     */
+    void setPriority(int priority);
+    int priority() const;
+
+    /**
+     * Lets \p responder answer the prompts directly instead of going
+     * through \ref request and \ref requestChanged. The responder isn't
+     * owned and has to outlive the authentication.
+     * @param responder the responder, null to go back to \ref request
+     */
+    void setResponder(QAuthResponder *responder);
+    QAuthResponder *responder() const;
+
 public Q_SLOTS:
     /**
      * Sets up the environment and starts the authentication
      */
     void start();
 
+    /**
+     * Stops the running authentication right away: the helper is terminated,
+     * \ref error is emitted with \ref ERROR_CANCELLED and \ref finished with
+     * false. Nothing more comes from the stopped helper. Does nothing if
+     * the instance isn't running.
+     */
+    void cancel();
+
 Q_SIGNALS:
     void autologinChanged();
     void verboseChanged();
@@ -140,8 +353,9 @@ Q_SIGNALS:
      * Emitted when authentication phase finishes
      *
      * @note If you want to set some environment variables for the session right before the
-     * session is started, connect to this signal using a blocking connection and insert anything
-     * you need in the slot.
+     * session is started, connect to this signal using a direct connection and insert anything
+     * you need in the slot. When a session is going to be started, the helper waits until
+     * the slots have returned, so everything inserted there ends up in the session.
      * @param user username
      * @param success true if succeeded
      */
@@ -179,9 +393,60 @@ Q_SIGNALS:
 private:
     class Private;
     class SocketServer;
+    class HelperPool;
+    class ForkServer;
+    class Multiplexer;
+    class Authenticator;
+    class Scheduler;
     friend Private;
     friend SocketServer;
+    friend HelperPool;
+    friend ForkServer;
+    friend Multiplexer;
+    friend Authenticator;
+    friend Scheduler;
     Private *d { nullptr };
 };
 
+#if QT_VERSION >= 0x050000 && defined(__cpp_impl_coroutine)
+# include <coroutine>
+# include <QtCore/QFutureWatcher>
+
+/**
+ * Lets coroutines wait for \ref QAuth::authenticate
+ *
+ * The coroutine is resumed from the event loop of the thread which
+ * awaited the result.
+ */
+class QAuthAwaitable {
+public:
+    explicit QAuthAwaitable(const QFuture<QAuth::AuthResult> &future)
+            : m_future(future) { }
+
+    bool await_ready() const {
+        return m_future.isFinished();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        QFutureWatcher<QAuth::AuthResult> *watcher = new QFutureWatcher<QAuth::AuthResult>();
+        QObject::connect(watcher, &QFutureWatcherBase::finished, [watcher, handle]() {
+            watcher->deleteLater();
+            handle.resume();
+        });
+        watcher->setFuture(m_future);
+    }
+
+    QAuth::AuthResult await_resume() const {
+        return m_future.result();
+    }
+
+private:
+    QFuture<QAuth::AuthResult> m_future;
+};
+
+inline QAuthAwaitable operator co_await(const QFuture<QAuth::AuthResult> &future) {
+    return QAuthAwaitable(future);
+}
+#endif
+
 #endif // QAUTH_H
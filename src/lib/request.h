@@ -95,7 +95,7 @@ Q_SIGNALS:
 private:
     QAuthRequest(QAuth *parent);
     void setRequest(const Request *request = nullptr);
-    Request request() const;
+    const Request &request() const;
     friend class QAuth;
     class Private;
     Private *d { nullptr };
@@ -0,0 +1,65 @@
+/*
+ * Qt Authentication library
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef RESPONDER_H
+#define RESPONDER_H
+
+#include "prompt.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+/**
+ * \brief
+ * Answers the prompts of a \ref QAuth right as they arrive
+ *
+ * \section description
+ * Meant for services answering the prompts without any user interaction.
+ * Install it with \ref QAuth::setResponder and \ref respond gets called
+ * straight from the code reading the helper's messages, the answers go
+ * back in the same turn of the event loop. No \ref QAuthPrompt objects
+ * are filled and \ref QAuth::requestChanged isn't emitted for the
+ * requests it answers.
+ *
+ * \ref respond must not block, the whole thread waits for it.
+ */
+class QAuthResponder {
+public:
+    /**
+     * One prompt of the request, see \ref QAuthPrompt
+     */
+    struct Prompt {
+        QAuthPrompt::Type type { QAuthPrompt::NONE };
+        QString message { };
+        bool hidden { false };
+        QByteArray response { }; ///< to be filled, the library wipes its copy once it's sent
+    };
+
+    virtual ~QAuthResponder() { }
+
+    /**
+     * Fills the responses of \p prompts
+     * @return false to leave the request to \ref QAuth::request instead
+     */
+    virtual bool respond(QList<Prompt> &prompts) = 0;
+};
+
+#endif // RESPONDER_H
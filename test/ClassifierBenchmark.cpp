@@ -0,0 +1,126 @@
+/*
+ * Cost of telling what PAM asks for
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "app/backend/PromptClassifier.h"
+
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtTest/QtTest>
+
+// more different messages than the classifier caches
+#define BENCHMARK_DISTINCT_MESSAGES 1024
+
+Q_DECLARE_METATYPE(QAuthPrompt::Type)
+
+/**
+ * The classifier against what PamData did before it, a new QRegExp for
+ * every rule on every call. Each message is classified as it comes
+ * repeatedly in one conversation (cached) and as a stream of messages
+ * the classifier hasn't seen yet, like ones naming the user (uncached).
+ */
+class ClassifierBenchmark : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void perCallRegExp_data();
+    void perCallRegExp();
+    void cached_data();
+    void cached();
+    void uncached();
+
+private:
+    static QAuthPrompt::Type perCall(const QString &message);
+};
+
+/*
+ * How it was done before the classifier
+ */
+QAuthPrompt::Type ClassifierBenchmark::perCall(const QString &message) {
+    if (message.indexOf(QRegExp("\\bpassword\\b", Qt::CaseInsensitive)) >= 0) {
+        if (message.indexOf(QRegExp("\\b(re-?(enter|type)|again|confirm|repeat)\\b", Qt::CaseInsensitive)) >= 0)
+            return QAuthPrompt::CHANGE_REPEAT;
+        else if (message.indexOf(QRegExp("\\bnew\\b", Qt::CaseInsensitive)) >= 0)
+            return QAuthPrompt::CHANGE_NEW;
+        else if (message.indexOf(QRegExp("\\b(old|current)\\b", Qt::CaseInsensitive)) >= 0)
+            return QAuthPrompt::CHANGE_CURRENT;
+        else
+            return QAuthPrompt::LOGIN_PASSWORD;
+    }
+    return QAuthPrompt::UNKNOWN;
+}
+
+void ClassifierBenchmark::initTestCase() {
+    // the helper forces LANG=C, only the built-in rules are compared
+    QCOMPARE(PromptClassifier::instance()->locale(), QString("C"));
+}
+
+void ClassifierBenchmark::perCallRegExp_data() {
+    QTest::addColumn<QString>("message");
+    QTest::addColumn<QAuthPrompt::Type>("type");
+
+    QTest::newRow("password") << "Password: " << QAuthPrompt::LOGIN_PASSWORD;
+    QTest::newRow("current") << "(current) UNIX password: " << QAuthPrompt::CHANGE_CURRENT;
+    QTest::newRow("new") << "New password: " << QAuthPrompt::CHANGE_NEW;
+    QTest::newRow("repeat") << "Retype new password: " << QAuthPrompt::CHANGE_REPEAT;
+    QTest::newRow("otp") << "Verification code: " << QAuthPrompt::UNKNOWN;
+}
+
+void ClassifierBenchmark::perCallRegExp() {
+    QFETCH(QString, message);
+    QFETCH(QAuthPrompt::Type, type);
+
+    QCOMPARE(perCall(message), type);
+    QBENCHMARK {
+        perCall(message);
+    }
+}
+
+void ClassifierBenchmark::cached_data() {
+    perCallRegExp_data();
+}
+
+void ClassifierBenchmark::cached() {
+    QFETCH(QString, message);
+    QFETCH(QAuthPrompt::Type, type);
+
+    PromptClassifier *classifier = PromptClassifier::instance();
+    QCOMPARE(classifier->prompt(message, false), type);
+    QBENCHMARK {
+        classifier->prompt(message, false);
+    }
+}
+
+void ClassifierBenchmark::uncached() {
+    QStringList messages;
+    for (int i = 0; i < BENCHMARK_DISTINCT_MESSAGES; i++)
+        messages << QString("Password for user%1: ").arg(i);
+
+    PromptClassifier *classifier = PromptClassifier::instance();
+    int next = 0;
+    QBENCHMARK {
+        classifier->prompt(messages[next], false);
+        next = (next + 1) % messages.length();
+    }
+}
+
+QTEST_MAIN(ClassifierBenchmark)
+
+#include "ClassifierBenchmark.moc"
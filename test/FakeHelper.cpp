@@ -0,0 +1,190 @@
+/*
+ * Helper passing every check without asking any backend
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "ChannelDevice.h"
+#include "Messages.h"
+#include "SafeDataStream.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtNetwork/QLocalSocket>
+
+/**
+ * The resident helper of the multiplexed transport, answering every BEGIN
+ * on a channel with AUTHENTICATED and FINISHED and closing the channel
+ */
+class FakeMultiplexer : public QObject {
+    Q_OBJECT
+public:
+    FakeMultiplexer(QLocalSocket *socket, int protocol);
+    ~FakeMultiplexer();
+
+private slots:
+    void dataPending();
+    void send(qint64 channel, const QByteArray &chunk);
+
+private:
+    void serve(qint64 channel);
+    void close(qint64 channel);
+
+    int m_protocol { PROTOCOL_V1 };
+    SafeDataStream m_in;
+    SafeDataStream m_out; ///< separate, replies are sent while a frame is being read
+    QHash<qint64, ChannelDevice*> m_channels { };
+    QHash<qint64, SafeDataStream*> m_streams { };
+};
+
+FakeMultiplexer::FakeMultiplexer(QLocalSocket *socket, int protocol)
+        : QObject(socket)
+        , m_protocol(protocol)
+        , m_in(socket)
+        , m_out(socket) {
+    m_in.setProtocol(protocol);
+    m_out.setProtocol(protocol);
+    connect(socket, SIGNAL(readyRead()), this, SLOT(dataPending()));
+    connect(socket, SIGNAL(disconnected()), QCoreApplication::instance(), SLOT(quit()));
+    if (socket->bytesAvailable() > 0)
+        dataPending();
+}
+
+FakeMultiplexer::~FakeMultiplexer() {
+    qDeleteAll(m_streams);
+}
+
+void FakeMultiplexer::dataPending() {
+    while (m_in.tryReceive()) {
+        qint64 channel = 0;
+        m_in >> channel;
+        QByteArray chunk = readBytes(m_in);
+        if (m_in.status() != QDataStream::Ok)
+            continue;
+
+        // the library hung up, or acknowledged our close
+        if (chunk.isEmpty()) {
+            if (m_channels.contains(channel))
+                close(channel);
+            continue;
+        }
+
+        if (!m_channels.contains(channel)) {
+            ChannelDevice *device = new ChannelDevice(channel, this);
+            connect(device, SIGNAL(outgoing(qint64,QByteArray)), this, SLOT(send(qint64,QByteArray)));
+            SafeDataStream *str = new SafeDataStream(device);
+            str->setProtocol(m_protocol);
+            m_channels[channel] = device;
+            m_streams[channel] = str;
+        }
+        m_channels[channel]->deliver(chunk);
+        serve(channel);
+    }
+}
+
+void FakeMultiplexer::serve(qint64 channel) {
+    SafeDataStream &str = *m_streams[channel];
+    while (str.tryReceive()) {
+        Msg m = MSG_UNKNOWN;
+        QString user;
+        str >> m;
+        if (m != BEGIN)
+            continue;
+        str >> WireString(user);
+        if (user.isEmpty())
+            user = "fake";
+
+        str.reset();
+        str << Msg::AUTHENTICATED << WireString(user);
+        str.send();
+        str.reset();
+        str << Msg::FINISHED << qint32(0);
+        str.send();
+        close(channel);
+        return;
+    }
+}
+
+void FakeMultiplexer::close(qint64 channel) {
+    ChannelDevice *device = m_channels.take(channel);
+    delete m_streams.take(channel);
+    device->close();
+    device->deleteLater();
+}
+
+void FakeMultiplexer::send(qint64 channel, const QByteArray &chunk) {
+    m_out.reset();
+    m_out << channel;
+    writeBytes(m_out, chunk);
+    m_out.send();
+}
+
+/*
+ * Speaks just enough of the protocol for the library to see a successful
+ * check: HELLO, AUTHENTICATED and the exit status, or FINISHED on every
+ * channel with --multiplex. Whatever else the library sends is ignored.
+ */
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QStringList args = QCoreApplication::arguments();
+    QString server;
+    QString user("fake");
+    qint64 id = 0;
+    int protocol = PROTOCOL_V1;
+    int pos;
+
+    if ((pos = args.indexOf("--socket")) >= 0 && pos < args.length() - 1)
+        server = args[pos + 1];
+    if ((pos = args.indexOf("--id")) >= 0 && pos < args.length() - 1)
+        id = args[pos + 1].toLongLong();
+    if ((pos = args.indexOf("--user")) >= 0 && pos < args.length() - 1)
+        user = args[pos + 1];
+    if ((pos = args.indexOf("--protocol")) >= 0 && pos < args.length() - 1)
+        protocol = qBound<int>(PROTOCOL_V1, args[pos + 1].toInt(), PROTOCOL_LATEST);
+
+    if (server.isEmpty() || id <= 0)
+        return 1;
+
+    QLocalSocket socket;
+    socket.connectToServer(server, QIODevice::ReadWrite | QIODevice::Unbuffered);
+    if (!socket.waitForConnected(5000))
+        return 1;
+
+    SafeDataStream str(&socket);
+    str << Msg::HELLO << id;
+    if (protocol > PROTOCOL_V1)
+        str << qint32(protocol);
+    str.send();
+
+    if (args.contains("--multiplex")) {
+        new FakeMultiplexer(&socket, protocol);
+        return app.exec();
+    }
+
+    str.setProtocol(protocol);
+    str.reset();
+    str << Msg::AUTHENTICATED << WireString(user);
+    str.send();
+    // older versions acknowledge it with the environment
+    if (protocol < PROTOCOL_V3)
+        str.receive();
+
+    return str.status() == QDataStream::Ok ? 0 : 1;
+}
+
+#include "FakeHelper.moc"
@@ -0,0 +1,168 @@
+/*
+ * Cost of sending and receiving frames with SafeDataStream
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "Messages.h"
+#include "SafeDataStream.h"
+
+#include <QtNetwork/QLocalSocket>
+#include <QtTest/QtTest>
+
+#include <atomic>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// messages counted for the allocations, after the buffers have grown
+#define BENCHMARK_COUNTED_MESSAGES 1000
+
+static std::atomic<quint64> allocations(0);
+
+#ifdef __GLIBC__
+/*
+ * Every allocation of the process goes through here, Qt's included
+ */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *data, size_t size);
+
+void *malloc(size_t size) __THROW {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) __THROW {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *data, size_t size) __THROW {
+    allocations++;
+    return __libc_realloc(data, size);
+}
+}
+#endif
+
+/**
+ * One frame at a time over a socketpair, like between the library and
+ * a helper. Besides the time, it reports how many bytes the framing copies
+ * into its buffer for every message (the header goes out separately, in
+ * the same syscall) and how many allocations both sides make per message
+ * once their buffers are big enough. The payload is written raw, so only
+ * the framing is measured, not the encoding of the messages.
+ */
+class FramingBenchmark : public QObject {
+    Q_OBJECT
+private slots:
+    void init();
+    void cleanup();
+
+    void roundTrip_data();
+    void roundTrip();
+
+private:
+    void transfer(const QByteArray &payload);
+
+    QLocalSocket *m_sender { nullptr };
+    QLocalSocket *m_receiver { nullptr };
+    SafeDataStream *m_out { nullptr };
+    SafeDataStream *m_in { nullptr };
+};
+
+void FramingBenchmark::init() {
+    int fds[2];
+    QVERIFY(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+    m_sender = new QLocalSocket(this);
+    m_receiver = new QLocalSocket(this);
+    QVERIFY(m_sender->setSocketDescriptor(fds[0], QLocalSocket::ConnectedState, QIODevice::ReadWrite | QIODevice::Unbuffered));
+    QVERIFY(m_receiver->setSocketDescriptor(fds[1], QLocalSocket::ConnectedState, QIODevice::ReadWrite | QIODevice::Unbuffered));
+    m_out = new SafeDataStream(m_sender);
+    m_in = new SafeDataStream(m_receiver);
+}
+
+void FramingBenchmark::cleanup() {
+    delete m_out;
+    delete m_in;
+    delete m_sender;
+    delete m_receiver;
+    m_out = m_in = nullptr;
+    m_sender = m_receiver = nullptr;
+}
+
+void FramingBenchmark::transfer(const QByteArray &payload) {
+    m_out->reset();
+    m_out->writeRawData(payload.constData(), payload.length());
+    m_out->send();
+    m_in->receive();
+    m_in->skipRawData(payload.length());
+}
+
+void FramingBenchmark::roundTrip_data() {
+    QTest::addColumn<int>("protocol");
+    QTest::addColumn<QByteArray>("payload");
+
+    // what a helper asking for the login and the password sends
+    Request request;
+    request.prompts << Prompt(QAuthPrompt::LOGIN_USER, "login: ", false);
+    request.prompts << Prompt(QAuthPrompt::LOGIN_PASSWORD, "Password: ", true);
+    for (int protocol = PROTOCOL_V1; protocol <= PROTOCOL_V2; protocol++) {
+        QByteArray encoded;
+        QDataStream str(&encoded, QIODevice::WriteOnly);
+        str.setByteOrder(protocol >= PROTOCOL_V2 ? QDataStream::LittleEndian : QDataStream::BigEndian);
+        str << Msg::REQUEST << request;
+        QTest::newRow(qPrintable(QString("v%1 request").arg(protocol))) << protocol << encoded;
+    }
+
+    QTest::newRow("v2 64k") << int(PROTOCOL_V2) << QByteArray(64 * 1024, 'x');
+}
+
+void FramingBenchmark::roundTrip() {
+    QFETCH(int, protocol);
+    QFETCH(QByteArray, payload);
+
+    m_out->setProtocol(protocol);
+    m_in->setProtocol(protocol);
+
+    // the buffers grow to the size of the frames first
+    transfer(payload);
+    QCOMPARE(m_in->status(), QDataStream::Ok);
+
+    quint64 before = allocations;
+    for (int i = 0; i < BENCHMARK_COUNTED_MESSAGES; i++)
+        transfer(payload);
+    quint64 allocated = allocations - before;
+    QCOMPARE(m_in->status(), QDataStream::Ok);
+#ifdef __GLIBC__
+    qDebug() << payload.length() << "B copied into the frame,"
+             << double(allocated) / BENCHMARK_COUNTED_MESSAGES << "allocations per message";
+#else
+    Q_UNUSED(allocated);
+    qDebug() << payload.length() << "B copied into the frame, allocations not counted without glibc";
+#endif
+
+    QBENCHMARK {
+        transfer(payload);
+    }
+}
+
+QTEST_MAIN(FramingBenchmark)
+
+#include "FramingBenchmark.moc"
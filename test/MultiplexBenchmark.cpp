@@ -0,0 +1,128 @@
+/*
+ * Many checks in flight at once, with and without the multiplexer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "qauth.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QEventLoop>
+#include <QtCore/QTimer>
+#include <QtTest/QtTest>
+
+// about what the broker keeps in flight
+#define BENCHMARK_CHECKS 200
+
+Q_DECLARE_METATYPE(QAuth::Transport)
+
+/**
+ * Starts a burst of checks at once against the fake helper and waits for
+ * all of them, once with a helper of their own each and once served by
+ * the resident helper over one connection. Reports the most descriptors
+ * the process had open during the burst.
+ */
+class MultiplexBenchmark : public QObject {
+    Q_OBJECT
+private slots:
+    void burst_data();
+    void burst();
+    void cleanup();
+
+public slots:
+    void checkFinished(bool success);
+
+private:
+    bool run(int count);
+    static int openDescriptors();
+
+    QEventLoop *m_loop { nullptr };
+    int m_running { 0 };
+    int m_failed { 0 };
+    int m_peakDescriptors { 0 };
+};
+
+int MultiplexBenchmark::openDescriptors() {
+    // sockets and pipes show up as broken links
+    return QDir("/proc/self/fd").entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).count();
+}
+
+void MultiplexBenchmark::checkFinished(bool success) {
+    m_peakDescriptors = qMax(m_peakDescriptors, openDescriptors());
+    if (!success)
+        m_failed++;
+    if (--m_running == 0)
+        m_loop->quit();
+}
+
+/*
+ * @return true if all \p count checks succeeded
+ */
+bool MultiplexBenchmark::run(int count) {
+    QList<QAuth*> checks;
+    for (int i = 0; i < count; i++) {
+        QAuth *auth = new QAuth("bench");
+        connect(auth, SIGNAL(finished(bool)), this, SLOT(checkFinished(bool)));
+        checks << auth;
+    }
+
+    QEventLoop loop;
+    m_loop = &loop;
+    m_running = count;
+    m_failed = 0;
+    QTimer::singleShot(60000, &loop, SLOT(quit()));
+    for (QAuth *auth : checks)
+        auth->start();
+    if (m_running > 0)
+        loop.exec();
+    m_loop = nullptr;
+
+    qDeleteAll(checks);
+    return m_running == 0 && m_failed == 0;
+}
+
+void MultiplexBenchmark::burst_data() {
+    QTest::addColumn<QAuth::Transport>("transport");
+
+    QTest::newRow("local server") << QAuth::TRANSPORT_LOCAL_SERVER;
+    QTest::newRow("multiplexed") << QAuth::TRANSPORT_MULTIPLEXED;
+}
+
+void MultiplexBenchmark::burst() {
+    QFETCH(QAuth::Transport, transport);
+
+    QAuth::setHelperTransport(transport);
+    // the resident helper has to connect first, until then checks get their own
+    QTest::qWait(500);
+    QVERIFY(run(1));
+
+    m_peakDescriptors = openDescriptors();
+    QVERIFY(run(BENCHMARK_CHECKS));
+    qDebug() << BENCHMARK_CHECKS << "checks in flight, at most" << m_peakDescriptors << "descriptors open";
+
+    QBENCHMARK {
+        run(BENCHMARK_CHECKS);
+    }
+}
+
+void MultiplexBenchmark::cleanup() {
+    QAuth::setHelperTransport(QAuth::TRANSPORT_LOCAL_SERVER);
+}
+
+QTEST_MAIN(MultiplexBenchmark)
+
+#include "MultiplexBenchmark.moc"
@@ -0,0 +1,192 @@
+/*
+ * Size and cost of the versions of the wire format
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "Messages.h"
+
+#include <QtTest/QtTest>
+
+/**
+ * Everything a login with a session sends in both directions, encoded and
+ * decoded with each version of the protocol: the request for the login and
+ * the password and its reply, AUTHENTICATED and the environment, the session
+ * status and the acknowledgements the older versions need. Reports the
+ * bytes per authentication, frame headers included.
+ */
+class ProtocolBenchmark : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void encode_data();
+    void encode();
+    void decode_data();
+    void decode();
+
+private:
+    QList<QByteArray> conversation(int protocol) const;
+    bool replay(int protocol, const QList<QByteArray> &frames) const;
+    static void setProtocol(QDataStream &str, int protocol);
+
+    Request m_request { };
+    Request m_answered { };
+    QString m_user { };
+    QProcessEnvironment m_environment { };
+};
+
+void ProtocolBenchmark::initTestCase() {
+    m_request.prompts << Prompt(QAuthPrompt::LOGIN_USER, "login: ", false);
+    m_request.prompts << Prompt(QAuthPrompt::LOGIN_PASSWORD, "Password: ", true);
+    m_answered = m_request;
+    m_answered.prompts[0].response = "alice";
+    m_answered.prompts[1].response = "correct horse battery staple";
+    m_user = "alice";
+
+    // about what a display manager sets for a session
+    m_environment.insert("PATH", "/usr/local/bin:/usr/bin:/bin");
+    m_environment.insert("DISPLAY", ":0");
+    m_environment.insert("XAUTHORITY", "/run/user/1000/xauth_aBcDeF");
+    m_environment.insert("XDG_SEAT", "seat0");
+    m_environment.insert("XDG_VTNR", "1");
+    m_environment.insert("XDG_SESSION_CLASS", "user");
+    m_environment.insert("XDG_SESSION_TYPE", "x11");
+    m_environment.insert("XDG_SESSION_DESKTOP", "KDE");
+    m_environment.insert("DESKTOP_SESSION", "plasma");
+    m_environment.insert("LANG", "en_US.UTF-8");
+}
+
+void ProtocolBenchmark::setProtocol(QDataStream &str, int protocol) {
+    // the same as SafeDataStream does
+    str.setByteOrder(protocol >= PROTOCOL_V2 ? QDataStream::LittleEndian : QDataStream::BigEndian);
+}
+
+QList<QByteArray> ProtocolBenchmark::conversation(int protocol) const {
+    QList<QByteArray> frames;
+    QByteArray frame;
+
+#define FRAME(messages) \
+    do { \
+        frame.clear(); \
+        QDataStream str(&frame, QIODevice::WriteOnly); \
+        setProtocol(str, protocol); \
+        str << messages; \
+        frames << frame; \
+    } while (0)
+
+    // since v3 the environment is there before anything happens
+    if (protocol >= PROTOCOL_V3)
+        FRAME(Msg::ENVIRONMENT << m_environment);
+    FRAME(Msg::REQUEST << m_request);
+    FRAME(Msg::REQUEST << Responses(m_answered));
+    FRAME(Msg::AUTHENTICATED << WireString(m_user));
+    if (protocol >= PROTOCOL_V3)
+        FRAME(Msg::ENVIRONMENT << QProcessEnvironment());
+    else
+        FRAME(Msg::AUTHENTICATED << m_environment);
+    FRAME(Msg::SESSION_STATUS << true);
+    if (protocol < PROTOCOL_V3)
+        FRAME(Msg::SESSION_STATUS);
+
+#undef FRAME
+    return frames;
+}
+
+/*
+ * Reads everything back the way both sides do
+ */
+bool ProtocolBenchmark::replay(int protocol, const QList<QByteArray> &frames) const {
+    int next = 0;
+    Msg m = MSG_UNKNOWN;
+    Request request;
+    Request sent(m_request);
+    QString user;
+    QProcessEnvironment env;
+    bool status = false;
+
+#define FRAME(expected, messages) \
+    do { \
+        if (next >= frames.length()) \
+            return false; \
+        QDataStream str(frames[next++]); \
+        setProtocol(str, protocol); \
+        str >> m; \
+        if (m != expected) \
+            return false; \
+        str messages; \
+        if (str.status() != QDataStream::Ok) \
+            return false; \
+    } while (0)
+
+    if (protocol >= PROTOCOL_V3)
+        FRAME(ENVIRONMENT, >> env);
+    FRAME(REQUEST, >> request);
+    // the helper reads the reply into what it sent
+    FRAME(REQUEST, >> Responses(sent));
+    FRAME(AUTHENTICATED, >> WireString(user));
+    if (protocol >= PROTOCOL_V3)
+        FRAME(ENVIRONMENT, >> env);
+    else
+        FRAME(AUTHENTICATED, >> env);
+    FRAME(SESSION_STATUS, >> status);
+    if (protocol < PROTOCOL_V3)
+        FRAME(SESSION_STATUS, .atEnd());
+
+#undef FRAME
+    return next == frames.length() && sent == m_answered;
+}
+
+void ProtocolBenchmark::encode_data() {
+    QTest::addColumn<int>("protocol");
+
+    for (int protocol = PROTOCOL_V1; protocol <= PROTOCOL_LATEST; protocol++)
+        QTest::newRow(qPrintable(QString("v%1").arg(protocol))) << protocol;
+}
+
+void ProtocolBenchmark::encode() {
+    QFETCH(int, protocol);
+
+    QList<QByteArray> frames = conversation(protocol);
+    int bytes = 0;
+    for (const QByteArray &frame : frames)
+        bytes += frame.length() + (protocol >= PROTOCOL_V2 ? WIRE_HEADER_SIZE : int(sizeof(qint64)));
+    qDebug() << bytes << "B per authentication in" << frames.length() << "frames";
+
+    QBENCHMARK {
+        conversation(protocol);
+    }
+}
+
+void ProtocolBenchmark::decode_data() {
+    encode_data();
+}
+
+void ProtocolBenchmark::decode() {
+    QFETCH(int, protocol);
+
+    QList<QByteArray> frames = conversation(protocol);
+    QVERIFY(replay(protocol, frames));
+
+    QBENCHMARK {
+        replay(protocol, frames);
+    }
+}
+
+QTEST_MAIN(ProtocolBenchmark)
+
+#include "ProtocolBenchmark.moc"
@@ -0,0 +1,187 @@
+/*
+ * Round trips through the shared memory rings and through a socket
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "Messages.h"
+#include "SafeDataStream.h"
+#include "SharedRing.h"
+
+#include <QtCore/QThread>
+#include <QtNetwork/QLocalSocket>
+#include <QtTest/QtTest>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+enum Transport {
+    SOCKET = 0,
+    RING
+};
+
+Q_DECLARE_METATYPE(Transport)
+
+/**
+ * The helper's side, sending every frame back until an empty one comes
+ */
+class Echo : public QThread {
+public:
+    Echo(Transport transport, const QString &address, int fd, int length)
+            : transport(transport)
+            , address(address)
+            , fd(fd)
+            , length(length) { }
+
+    Transport transport { SOCKET };
+    QString address { };
+    int fd { -1 };
+    int length { 0 };
+
+protected:
+    void run() {
+        QIODevice *device = nullptr;
+        if (transport == RING) {
+            device = SharedRing::attach(address);
+        }
+        else {
+            QLocalSocket *socket = new QLocalSocket();
+            socket->setSocketDescriptor(fd, QLocalSocket::ConnectedState, QIODevice::ReadWrite | QIODevice::Unbuffered);
+            device = socket;
+        }
+        if (!device)
+            return;
+
+        QByteArray payload(length, Qt::Uninitialized);
+        SafeDataStream str(device);
+        str.setProtocol(PROTOCOL_LATEST);
+        forever {
+            str.receive();
+            if (str.status() != QDataStream::Ok || str.atEnd())
+                break;
+            str.readRawData(payload.data(), length);
+            str.reset();
+            str.writeRawData(payload.constData(), length);
+            str.send();
+        }
+        delete device;
+    }
+};
+
+/**
+ * A frame to the helper and the same one back, with the helper's side
+ * in a thread of its own, so the wakeups are counted in as well
+ */
+class RingBenchmark : public QObject {
+    Q_OBJECT
+private slots:
+    void init();
+    void cleanup();
+
+    void roundTrip_data();
+    void roundTrip();
+
+private:
+    bool connectTo(Transport transport, int length);
+    bool transfer(const QByteArray &payload);
+
+    QIODevice *m_device { nullptr };
+    SafeDataStream *m_stream { nullptr };
+    Echo *m_echo { nullptr };
+};
+
+bool RingBenchmark::connectTo(Transport transport, int length) {
+    if (transport == RING) {
+        QList<int> childFds;
+        SharedRing *ring = SharedRing::create(&childFds, this);
+        if (!ring)
+            return false;
+        m_device = ring;
+        m_echo = new Echo(RING, ring->address(), -1, length);
+    }
+    else {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+            return false;
+        QLocalSocket *socket = new QLocalSocket(this);
+        socket->setSocketDescriptor(fds[0], QLocalSocket::ConnectedState, QIODevice::ReadWrite | QIODevice::Unbuffered);
+        m_device = socket;
+        m_echo = new Echo(SOCKET, QString(), fds[1], length);
+    }
+    m_stream = new SafeDataStream(m_device);
+    m_stream->setProtocol(PROTOCOL_LATEST);
+    m_echo->start();
+    return true;
+}
+
+void RingBenchmark::init() {
+    m_device = nullptr;
+    m_stream = nullptr;
+    m_echo = nullptr;
+}
+
+void RingBenchmark::cleanup() {
+    if (m_echo) {
+        // an empty frame ends the echo
+        m_stream->reset();
+        m_stream->send();
+        m_echo->wait();
+        delete m_echo;
+    }
+    delete m_stream;
+    delete m_device;
+    // the helper's copies of the descriptors are closed by its side
+}
+
+bool RingBenchmark::transfer(const QByteArray &payload) {
+    m_stream->reset();
+    m_stream->writeRawData(payload.constData(), payload.length());
+    m_stream->send();
+    m_stream->receive();
+    m_stream->skipRawData(payload.length());
+    return m_stream->status() == QDataStream::Ok;
+}
+
+void RingBenchmark::roundTrip_data() {
+    QTest::addColumn<Transport>("transport");
+    QTest::addColumn<int>("length");
+
+    // about a REQUEST for the login and the password
+    QTest::newRow("socket 64 B") << SOCKET << 64;
+    QTest::newRow("ring 64 B") << RING << 64;
+    // has to fit the ring, the library doesn't wait for space
+    QTest::newRow("socket 16 KiB") << SOCKET << 16 * 1024;
+    QTest::newRow("ring 16 KiB") << RING << 16 * 1024;
+}
+
+void RingBenchmark::roundTrip() {
+    QFETCH(Transport, transport);
+    QFETCH(int, length);
+
+    if (!connectTo(transport, length))
+        QSKIP("The transport isn't available here", SkipSingle);
+
+    QByteArray payload(length, 'x');
+    QVERIFY(transfer(payload));
+    QBENCHMARK {
+        transfer(payload);
+    }
+}
+
+QTEST_MAIN(RingBenchmark)
+
+#include "RingBenchmark.moc"
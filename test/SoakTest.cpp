@@ -0,0 +1,114 @@
+/*
+ * Memory and descriptors of a process running many checks
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "qauth.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtCore/QTimer>
+#include <QtTest/QtTest>
+
+#include <unistd.h>
+
+// the first checks set up the local server and whatever Qt caches on its own
+#define SOAK_WARM_UP 100
+// the heap never gives everything back, but it mustn't grow with the checks
+#define SOAK_MAX_GROWTH (4 * 1024 * 1024)
+
+/**
+ * Greeters and brokers run for weeks, one check after another. This runs
+ * as many of them against the fake helper (100000 unless QAUTH_SOAK_CHECKS
+ * says otherwise) and expects the same resident memory and the same open
+ * descriptors at the end as after the warm-up.
+ */
+class SoakTest : public QObject {
+    Q_OBJECT
+private slots:
+    void checks();
+
+private:
+    static bool check();
+    static void settle();
+    static qint64 residentMemory();
+    static int openDescriptors();
+};
+
+bool SoakTest::check() {
+    QAuth auth("soak");
+    QEventLoop loop;
+    QSignalSpy finished(&auth, SIGNAL(finished(bool)));
+    connect(&auth, SIGNAL(finished(bool)), &loop, SLOT(quit()));
+    QTimer::singleShot(10000, &loop, SLOT(quit()));
+    auth.start();
+    if (finished.isEmpty())
+        loop.exec();
+    return finished.count() == 1 && finished.first().first().toBool();
+}
+
+/*
+ * Everything deleted later is gone before anything is measured
+ */
+void SoakTest::settle() {
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    QCoreApplication::processEvents();
+}
+
+qint64 SoakTest::residentMemory() {
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+    QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.length() < 2)
+        return -1;
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+int SoakTest::openDescriptors() {
+    // sockets and pipes show up as broken links
+    return QDir("/proc/self/fd").entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).count();
+}
+
+void SoakTest::checks() {
+    int count = qgetenv("QAUTH_SOAK_CHECKS").toInt();
+    if (count <= 0)
+        count = 100000;
+
+    for (int i = 0; i < SOAK_WARM_UP; i++)
+        QVERIFY(check());
+    settle();
+    qint64 memory = residentMemory();
+    int descriptors = openDescriptors();
+    QVERIFY(memory > 0);
+
+    for (int i = 0; i < count; i++) {
+        if (!check())
+            QFAIL(qPrintable(QString("Check %1 of %2 failed").arg(i + 1).arg(count)));
+    }
+    settle();
+
+    qDebug() << count << "checks: RSS" << memory << "->" << residentMemory() << "B, descriptors" << descriptors << "->" << openDescriptors();
+    QCOMPARE(openDescriptors(), descriptors);
+    QVERIFY(residentMemory() - memory < SOAK_MAX_GROWTH);
+}
+
+QTEST_MAIN(SoakTest)
+
+#include "SoakTest.moc"
@@ -0,0 +1,143 @@
+/*
+ * Checks whose helper can't be started
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "batch.h"
+#include "qauth.h"
+
+#include <QtCore/QEventLoop>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QTimer>
+#include <QtTest/QtTest>
+
+// more than the limit lets run at once
+#define SPAWN_CHECKS 5
+
+/**
+ * The library here launches a helper which doesn't exist. Every check
+ * has to fail and finish anyway, without holding up the ones after it.
+ */
+class SpawnFailureTest : public QObject {
+    Q_OBJECT
+private slots:
+    void cleanup();
+
+    void limitedConcurrency();
+    void authenticate();
+    void batch();
+
+public slots:
+    void checkFinished(bool success);
+
+private:
+    QEventLoop *m_loop { nullptr };
+    int m_running { 0 };
+    int m_succeeded { 0 };
+};
+
+void SpawnFailureTest::cleanup() {
+    QAuth::setMaxConcurrentHelpers(0);
+}
+
+void SpawnFailureTest::checkFinished(bool success) {
+    if (success)
+        m_succeeded++;
+    if (--m_running == 0 && m_loop)
+        m_loop->quit();
+}
+
+void SpawnFailureTest::limitedConcurrency() {
+    QAuth::setMaxConcurrentHelpers(1);
+
+    QList<QAuth*> checks;
+    for (int i = 0; i < SPAWN_CHECKS; i++) {
+        QAuth *auth = new QAuth("spawn");
+        connect(auth, SIGNAL(finished(bool)), this, SLOT(checkFinished(bool)));
+        checks << auth;
+    }
+
+    QEventLoop loop;
+    m_loop = &loop;
+    m_running = SPAWN_CHECKS;
+    m_succeeded = 0;
+    QTimer::singleShot(10000, &loop, SLOT(quit()));
+    for (QAuth *auth : checks)
+        auth->start();
+    if (m_running > 0)
+        loop.exec();
+    m_loop = nullptr;
+    qDeleteAll(checks);
+
+    QCOMPARE(m_running, 0);
+    QCOMPARE(m_succeeded, 0);
+    QCOMPARE(QAuth::queueDepth(), 0);
+}
+
+void SpawnFailureTest::authenticate() {
+    QFutureWatcher<QAuth::AuthResult> watcher;
+    QEventLoop loop;
+    connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(10000, &loop, SLOT(quit()));
+    watcher.setFuture(QAuth::authenticate("spawn", "secret"));
+    if (!watcher.isFinished())
+        loop.exec();
+
+    QVERIFY(watcher.isFinished());
+    QAuth::AuthResult result = watcher.result();
+    QVERIFY(!result.success);
+    QVERIFY(result.user.isEmpty());
+    QCOMPARE(result.error, QAuth::ERROR_INTERNAL);
+}
+
+void SpawnFailureTest::batch() {
+    QAuthBatch batch;
+    batch.setConcurrency(2);
+    QSignalSpy results(&batch, SIGNAL(result(int,QString,bool)));
+    QSignalSpy finished(&batch, SIGNAL(finished()));
+    QEventLoop loop;
+    connect(&batch, SIGNAL(finished()), &loop, SLOT(quit()));
+
+    // the second run goes on numbering where the first one stopped
+    for (int run = 0; run < 2; run++) {
+        for (int i = 0; i < SPAWN_CHECKS; i++)
+            batch.add(QString("spawn%1").arg(i), "secret");
+        QTimer::singleShot(10000, &loop, SLOT(quit()));
+        batch.start();
+        if (finished.count() == run)
+            loop.exec();
+        QCOMPARE(finished.count(), run + 1);
+        QCOMPARE(batch.completed(), SPAWN_CHECKS);
+        QCOMPARE(batch.succeeded(), 0);
+    }
+
+    QCOMPARE(batch.count(), 2 * SPAWN_CHECKS);
+    QCOMPARE(results.count(), 2 * SPAWN_CHECKS);
+    QList<int> indexes;
+    for (const QList<QVariant> &result : results) {
+        indexes << result[0].toInt();
+        QVERIFY(!result[2].toBool());
+    }
+    qSort(indexes);
+    for (int i = 0; i < indexes.length(); i++)
+        QCOMPARE(indexes[i], i);
+}
+
+QTEST_MAIN(SpawnFailureTest)
+
+#include "SpawnFailureTest.moc"